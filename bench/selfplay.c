@@ -0,0 +1,572 @@
+///
+// selfplay.c
+// ==========
+//
+// Multithreaded bot self-play benchmark.
+//
+// Each worker thread owns a pool of engines and plays 40 line sprints with a
+// placement policy. Every game is driven through the headless
+// `fsGameRunInputs` path using the same key states a player would press, so
+// the engine, control and finesse code are all exercised. Games within a pool
+// are advanced one piece at a time in turn.
+//
+// Statistics are accumulated per-thread and only summed once every worker has
+// been joined, so threads never write to shared memory while running.
+//
+// Passing `-m 1` runs the games with 1 ms ticks, where ticks/s gives the cost
+// of a tick in the 1000Hz logic mode.
+//
+// Usage: selfplay [-t threads] [-g games] [-p pool] [-s seed] [-m msPerTick]
+//                 [-P policy]
+///
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <faststack.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Upper bound on the number of placements a single piece can have.
+#define MAX_PLACEMENTS (FS_NPR * FS_MAX_WIDTH * FS_MAX_HEIGHT)
+
+// Lines to clear for a sprint to be completed.
+#define SPRINT_GOAL 40
+
+///
+// A placement policy chooses one of the generated placements for the current
+// piece, returning its index in `p`.
+///
+typedef i32 (*Policy)(const FSEngine *f, const FSPlacement *p, i32 count,
+                      FSRandCtx *ctx);
+
+///
+// Statistics accumulated over every game played by a worker.
+///
+typedef struct Stats {
+    long long games;
+    long long completed;
+    long long ticks;
+    long long gameTicks;
+    long long msPlayed;
+    long long blocks;
+    long long lines;
+    long long finesse;
+    long long keys;
+    double seconds;
+} Stats;
+
+///
+// A single engine of a workers pool.
+///
+typedef struct Slot {
+    FSEngine f;
+    FSControl c;
+    bool active;
+} Slot;
+
+///
+// State owned by a single worker thread.
+///
+typedef struct Worker {
+    pthread_t thread;
+
+    /// Index of this worker.
+    int id;
+
+    /// Total number of workers. Game seeds are strided by this value.
+    int count;
+
+    /// Number of games this worker plays.
+    long long gameCount;
+
+    /// Number of engines to interleave.
+    int poolSize;
+
+    /// Seed of the first game played across all workers.
+    u32 seed;
+
+    /// Engine options every game is started with.
+    const FSEngineConfig *config;
+
+    Policy policy;
+    FSRandCtx rand;
+    FSPlacement *placements;
+
+    Stats stats;
+
+    // Keep the statistics of neighbouring workers on separate cache lines.
+    char pad[64];
+} Worker;
+
+///
+// Choose a placement uniformly at random.
+///
+static i32 policyRandom(const FSEngine *f, const FSPlacement *p, i32 count,
+                        FSRandCtx *ctx)
+{
+    (void) f;
+    (void) p;
+    return fsRandNext(ctx) % count;
+}
+
+///
+// Combine the features of a field into a single score.
+//
+// This uses the four feature evaluation of aggregate height, cleared lines,
+// holes and bumpiness with weights from Yiyuan Lee's tuned player.
+///
+static double scoreField(int aggregate, int lines, int holes, int bumpiness)
+{
+    return -0.510066 * aggregate + 0.760666 * lines -
+            0.35663 * holes - 0.184483 * bumpiness;
+}
+
+///
+// Score the field resulting from a placement which clears lines.
+//
+// Every column can change height, so the resulting field is rebuilt and
+// scanned in full.
+///
+static double evaluateClear(const FSEngine *f, const FSPieceMask *m,
+                            const FSPlacement *p)
+{
+    const int w = f->config->fieldWidth;
+    const int h = f->config->fieldHeight;
+
+    // Lock the piece and compact the remaining rows towards the floor. Only
+    // rows `top` to `h - 1` are non-empty afterwards.
+    FSRowMask rows[FS_MAX_HEIGHT];
+    int lines = 0;
+    int top = h;
+
+    for (int y = h - 1; y >= 0; --y) {
+        FSRowMask row = f->rowMask[y];
+        const int r = y - p->y;
+        if (r >= m->minY && r <= m->maxY) {
+            row |= (FSRowMask) m->rows[r] << (p->x + FS_ROW_PAD);
+        }
+
+        if (row == FS_ROW_FULL) {
+            lines += 1;
+        }
+        else {
+            rows[--top] = row;
+        }
+    }
+
+    int aggregate = 0, holes = 0, bumpiness = 0, last = 0;
+    for (int x = 0; x < w; ++x) {
+        const FSRowMask bit = (FSRowMask) 1 << (x + FS_ROW_PAD);
+
+        int height = 0;
+        for (int y = top; y < h; ++y) {
+            if (rows[y] & bit) {
+                if (!height) {
+                    height = h - y;
+                }
+            }
+            else if (height) {
+                holes += 1;
+            }
+        }
+
+        aggregate += height;
+        if (x) {
+            bumpiness += abs(height - last);
+        }
+        last = height;
+    }
+
+    return scoreField(aggregate, lines, holes, bumpiness);
+}
+
+///
+// Score the field resulting from a placement.
+//
+// Without a line clear only the columns covered by the piece change height,
+// so the column heights and row fills maintained by the engine are used
+// instead of rescanning the field. Every cell below a column top which is
+// not filled is a hole.
+///
+static double evaluatePlacement(const FSEngine *f, const FSPlacement *p)
+{
+    const FSPieceMask *m = &pieceMasks[f->config->rotationSystem][f->piece][p->theta];
+    const int h = f->config->fieldHeight;
+
+    for (int r = m->minY; r <= m->maxY; ++r) {
+        const FSRowMask row = f->rowMask[p->y + r] |
+                        (FSRowMask) m->rows[r] << (p->x + FS_ROW_PAD);
+        if (row == FS_ROW_FULL) {
+            return evaluateClear(f, m, p);
+        }
+    }
+
+    int cells = FS_NBP;
+    for (int y = 0; y < h; ++y) {
+        cells += f->rowFill[y];
+    }
+
+    int aggregate = 0, bumpiness = 0, last = 0;
+    for (int x = 0; x < f->config->fieldWidth; ++x) {
+        int height = f->columnHeight[x];
+
+        const int c = x - p->x;
+        if (c >= m->minX && c <= m->maxX) {
+            int r = m->minY;
+            while (!(m->rows[r] & (1 << c))) {
+                r += 1;
+            }
+            if (height < h - (p->y + r)) {
+                height = h - (p->y + r);
+            }
+        }
+
+        aggregate += height;
+        if (x) {
+            bumpiness += abs(height - last);
+        }
+        last = height;
+    }
+
+    return scoreField(aggregate, 0, aggregate - cells, bumpiness);
+}
+
+///
+// Choose the placement with the best immediate evaluation.
+///
+static i32 policyHeuristic(const FSEngine *f, const FSPlacement *p, i32 count,
+                           FSRandCtx *ctx)
+{
+    (void) ctx;
+
+    i32 best = 0;
+    double bestScore = evaluatePlacement(f, &p[0]);
+
+    for (i32 i = 1; i < count; ++i) {
+        const double score = evaluatePlacement(f, &p[i]);
+        if (score > bestScore) {
+            best = i;
+            bestScore = score;
+        }
+    }
+
+    return best;
+}
+
+static const struct {
+    const char *name;
+    Policy policy;
+} policies[] = {
+    { "heuristic", policyHeuristic },
+    { "random", policyRandom }
+};
+
+///
+// Key held for each placement move.
+///
+static const u32 moveKeys[] = {
+    [FST_MOVE_LEFT] = FST_VK_FLAG_LEFT,
+    [FST_MOVE_RIGHT] = FST_VK_FLAG_RIGHT,
+    [FST_MOVE_ROTR] = FST_VK_FLAG_ROTR,
+    [FST_MOVE_ROTL] = FST_VK_FLAG_ROTL,
+    [FST_MOVE_ROTH] = FST_VK_FLAG_ROTH,
+    [FST_MOVE_DOWN] = FST_VK_FLAG_DOWN,
+    [FST_MOVE_DROP] = FST_VK_FLAG_DOWN
+};
+
+///
+// Run a single tick with the specified keys held.
+//
+// Returns false if the game has already finished.
+///
+static bool press(Slot *s, u32 keys)
+{
+    return fsGameRunInputs(&s->f, &s->c, &keys, 1, NULL) == 1;
+}
+
+///
+// Apply a single placement move.
+//
+// Soft drop moves the piece a single row for every tick it is held. Any other
+// key needs to be released first if it is already held, else it would not
+// register as a new press.
+///
+static void applyMove(Slot *s, i8 move)
+{
+    const u32 key = moveKeys[move];
+
+    if (move == FST_MOVE_DROP) {
+        while (s->f.y < s->f.hardDropY && press(s, key)) {
+        }
+        return;
+    }
+
+    if (move != FST_MOVE_DOWN && (s->c.lastKeys & key)) {
+        press(s, 0);
+    }
+    press(s, key);
+}
+
+///
+// Place the next piece of a game.
+//
+// Returns false if the game has finished.
+///
+static bool playPiece(Worker *w, Slot *s)
+{
+    FSEngine *f = &s->f;
+
+    while (f->state != FSS_FALLING && f->state != FSS_LANDED) {
+        if (!press(s, 0)) {
+            return false;
+        }
+    }
+
+    const i32 n = fsGenerateDropPlacements(f, w->placements, MAX_PLACEMENTS);
+    if (n > 0) {
+        const i32 i = w->policy(f, w->placements, n, &w->rand);
+        const FSPlacement *p = &w->placements[i];
+
+        for (int j = 0; j < p->pathLength; ++j) {
+            applyMove(s, p->path[j]);
+        }
+    }
+
+    press(s, FST_VK_FLAG_UP);
+    return true;
+}
+
+///
+// Start the specified game of a worker in a pool slot.
+///
+static void startGame(Worker *w, Slot *s, long long game)
+{
+    fsGameInit(&s->f, w->config);
+    s->f.seed = w->seed + (u32) (game * w->count + w->id);
+    fsGameReset(&s->f);
+    memset(&s->c, 0, sizeof(s->c));
+    s->active = true;
+}
+
+static void recordGame(Stats *st, const FSEngine *f)
+{
+    st->games += 1;
+    st->completed += f->linesCleared >= f->config->goal;
+    st->ticks += f->totalTicksRaw;
+    st->gameTicks += f->totalTicks;
+    st->msPlayed += (long long) f->totalTicks * f->config->msPerTick;
+    st->blocks += f->blocksPlaced;
+    st->lines += f->linesCleared;
+    st->finesse += f->finesse;
+    st->keys += f->totalKeysPressed;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void* runWorker(void *arg)
+{
+    Worker *w = arg;
+    Slot *pool = malloc(w->poolSize * sizeof(Slot));
+    w->placements = malloc(MAX_PLACEMENTS * sizeof(FSPlacement));
+
+    if (!pool || !w->placements) {
+        fprintf(stderr, "worker %d: out of memory\n", w->id);
+        exit(1);
+    }
+
+    const double start = now();
+
+    long long started = 0;
+    int active = 0;
+    for (int i = 0; i < w->poolSize; ++i) {
+        pool[i].active = false;
+        if (started < w->gameCount) {
+            startGame(w, &pool[i], started++);
+            active += 1;
+        }
+    }
+
+    while (active) {
+        for (int i = 0; i < w->poolSize; ++i) {
+            Slot *s = &pool[i];
+            if (!s->active || playPiece(w, s)) {
+                continue;
+            }
+
+            recordGame(&w->stats, &s->f);
+            if (started < w->gameCount) {
+                startGame(w, s, started++);
+            }
+            else {
+                s->active = false;
+                active -= 1;
+            }
+        }
+    }
+
+    w->stats.seconds = now() - start;
+
+    free(w->placements);
+    free(pool);
+    return NULL;
+}
+
+static void printStats(const char *name, const Stats *st, double seconds)
+{
+    const double gameSeconds = st->msPlayed / 1000.0;
+    const double blocks = st->blocks ? (double) st->blocks : 1;
+
+    printf("%-8s %7lld games (%lld completed) %9.1f games/s %12.0f ticks/s "
+           "%6.2f TPS %5.2f finesse/piece %5.2f keys/piece\n",
+            name, st->games, st->completed,
+            st->games / seconds, st->ticks / seconds,
+            gameSeconds > 0 ? st->blocks / gameSeconds : 0,
+            st->finesse / blocks, st->keys / blocks);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-t threads] [-g games] [-p pool] [-s seed] "
+            "[-m msPerTick] [-P heuristic|random]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    int threadCount = 4;
+    long long gameCount = 1000;
+    int poolSize = 8;
+    u32 seed = 1;
+    int msPerTick = FSD_MS_PER_TICK;
+    Policy policy = policyHeuristic;
+    const char *policyName = policies[0].name;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][2] != 0 ||
+                i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+          case 't':
+            threadCount = atoi(value);
+            break;
+          case 'g':
+            gameCount = atoll(value);
+            break;
+          case 'p':
+            poolSize = atoi(value);
+            break;
+          case 's':
+            seed = strtoul(value, NULL, 10);
+            break;
+          case 'm':
+            msPerTick = atoi(value);
+            break;
+          case 'P':
+            policy = NULL;
+            for (size_t j = 0; j < sizeof(policies) / sizeof(policies[0]); ++j) {
+                if (!strcmp(value, policies[j].name)) {
+                    policy = policies[j].policy;
+                    policyName = policies[j].name;
+                }
+            }
+            if (!policy) {
+                usage(argv[0]);
+            }
+            break;
+          default:
+            usage(argv[0]);
+        }
+    }
+
+    if (threadCount < 1 || gameCount < 1 || poolSize < 1 ||
+            msPerTick < 1 || msPerTick > 127) {
+        usage(argv[0]);
+    }
+
+    // The piece masks are initialized on first use, which must complete
+    // before any worker starts. Workers then only read the shared config.
+    FSEngineConfig config;
+    fsConfigInit(&config);
+    fsInitPieceMasks();
+    config.msPerTick = msPerTick;
+    config.gravity = 0;
+    config.softDropGravity = fix(1) / config.msPerTick;
+    config.lockDelay = 1000000;
+    config.readyPhaseLength = 0;
+    config.goPhaseLength = 0;
+    config.goal = SPRINT_GOAL;
+
+    Worker *workers = calloc(threadCount, sizeof(Worker));
+    if (!workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("threads %d, games %lld, pool %d, seed %u, policy %s\n\n",
+            threadCount, gameCount, poolSize, seed, policyName);
+
+    const double start = now();
+
+    for (int i = 0; i < threadCount; ++i) {
+        Worker *w = &workers[i];
+        w->id = i;
+        w->count = threadCount;
+        w->gameCount = gameCount / threadCount + (i < gameCount % threadCount);
+        w->poolSize = poolSize;
+        w->seed = seed;
+        w->config = &config;
+        w->policy = policy;
+        fsRandSeed(&w->rand, seed + i);
+
+        if (pthread_create(&w->thread, NULL, runWorker, w)) {
+            fprintf(stderr, "failed to create worker %d\n", i);
+            return 1;
+        }
+    }
+
+    Stats total;
+    memset(&total, 0, sizeof(total));
+
+    for (int i = 0; i < threadCount; ++i) {
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    const double elapsed = now() - start;
+
+    for (int i = 0; i < threadCount; ++i) {
+        const Stats *st = &workers[i].stats;
+        char name[32];
+        snprintf(name, sizeof(name), "thread %d", i);
+        printStats(name, st, st->seconds);
+
+        total.games += st->games;
+        total.completed += st->completed;
+        total.ticks += st->ticks;
+        total.gameTicks += st->gameTicks;
+        total.msPlayed += st->msPlayed;
+        total.blocks += st->blocks;
+        total.lines += st->lines;
+        total.finesse += st->finesse;
+        total.keys += st->keys;
+    }
+
+    printf("\n");
+    printStats("total", &total, elapsed);
+    printf("\n%.3fs elapsed, %lld lines, %lld blocks\n",
+            elapsed, total.lines, total.blocks);
+
+    free(workers);
+    return 0;
+}
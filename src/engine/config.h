@@ -14,19 +14,52 @@
 
 // Maximum height of a playfield.
 //
+// The actual field height is set at runtime and can be anything up to this.
+//
 // Notes:
-//  - This is currently constrained by an upper bound of 32 due to the
-//    algorithm used for clearing lines.
+//  - Row positions are stored as an i8 so this is constrained by an upper
+//    bound of 126.
+#ifndef FS_MAX_HEIGHT
 #define FS_MAX_HEIGHT 25
+#endif
 
 // Maximum width of a playfield.
+//
+// The actual field width is set at runtime and can be anything up to this.
+//
+// Notes:
+//  - Each row is mirrored as a bitmask with 3 wall cells either side. This
+//    is 32-bit for widths up to 26 and 64-bit otherwise, so this is
+//    constrained by an upper bound of 58.
+#ifndef FS_MAX_WIDTH
 #define FS_MAX_WIDTH 20
+#endif
 
 // Maximum number of wallkick tests in a single rotation system.
 #define FS_MAX_KICK_LEN 10
 
-// Maximum size of preview piece buffer.
-#define FS_MAX_PREVIEW_COUNT 5
+// Maximum number of preview pieces.
+//
+// Upcoming pieces are held in a ring of this length, which is part of every
+// engine and snapshot. Builds which want a deeper preview can raise it.
+//
+// Notes:
+//  - This must be a power of two.
+#ifndef FS_MAX_PREVIEW_COUNT
+#define FS_MAX_PREVIEW_COUNT 8
+#endif
+
+// Maximum number of key changes a frontend records between two ticks.
+#define FS_MAX_KEY_EVENTS 64
+
+// Maximum number of preview pieces drawn by a frontend.
+#define FS_MAX_PREVIEW_DRAWN 5
+
+// Number of snapshots retained by a snapshot ring.
+#define FS_SNAPSHOT_RING_LEN 32
+
+// Maximum number of moves in a generated placement path.
+#define FS_MAX_PATH_LEN 48
 
 // Maximum scratch space for internal randomizer buffer.
 #define FS_RAND_BUFFER_LEN 63
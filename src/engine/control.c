@@ -21,76 +21,10 @@ i32 popcount(u32 x)
 }
 
 ///
-// Transform the current input state into a simple set of actions for the
-// engine to apply.
-//
-// `keys` is an integer with bits set depending on the state of the specified
-//  key. The bits set correspond to the `FST_VK_FLAG` enum in `fsControl.h`.
+// Generate the actions of keys which were pressed since the last conversion.
 ///
-void fsVirtualKeysToInput(FSInput *dst, u32 keys, const FSEngine *f, FSControl *c)
+static void applyNewKeys(FSInput *dst, u32 newKeys, const FSEngine *f)
 {
-    u32 lastTickKeys = c->lastKeys;
-    u32 newKeys = keys & ~lastTickKeys;
-    c->lastKeys = keys;
-
-    c->currentKeys &= keys;
-    keys &= ~c->currentKeys;
-    newKeys &= keys;
-    dst->currentKeys = keys;
-    dst->newKeysCount = popcount(newKeys);
-
-    if (keys & FST_VK_FLAG_LEFT) {
-        if (c->dasCounter > TICKS(-f->dasDelay)) {
-            if (c->dasCounter >= 0) {
-                c->dasCounter = -1;
-                dst->movement = -1;
-            }
-            else {
-                c->dasCounter -= 1;
-            }
-        }
-        else {
-            int dasSpeed = f->dasSpeed;
-            if (dasSpeed) {
-                dst->movement = -1;
-                c->dasCounter += dasSpeed - 1;
-            }
-            else {
-                dst->movement = -f->fieldWidth;
-            }
-        }
-    }
-    else if (keys & FST_VK_FLAG_RIGHT) {
-        if (c->dasCounter < TICKS(f->dasDelay)) {
-            if (c->dasCounter <= 0) {
-                c->dasCounter = 1;
-                dst->movement = 1;
-            }
-            else {
-                c->dasCounter += 1;
-            }
-        }
-        else {
-            int dasSpeed = f->dasSpeed;
-            if (dasSpeed) {
-                dst->movement = 1;
-                c->dasCounter -= dasSpeed - 1;
-            }
-            else {
-                dst->movement = f->fieldWidth;
-            }
-        }
-    }
-    else {
-        c->dasCounter = 0;
-    }
-
-    const int sdKeysToCheck = f->oneShotSoftDrop ? newKeys : keys;
-    if (sdKeysToCheck & FST_VK_FLAG_DOWN) {
-        // Note: This fix/unfix is a little messy and should be consolidated
-        dst->gravity = unfixflr(f->msPerTick * f->softDropGravity);
-    }
-
     // A double keypress should only affect finesse once. Arguably we want two
     // flags here but unsure how common this case would be anyway.
     if (newKeys & (FST_VK_FLAG_RIGHT | FST_VK_FLAG_LEFT)) {
@@ -113,7 +47,7 @@ void fsVirtualKeysToInput(FSInput *dst, u32 keys, const FSEngine *f, FSControl *
         dst->extra |= FST_INPUT_HOLD;
     }
     if (newKeys & FST_VK_FLAG_UP) {
-        dst->gravity = f->fieldHeight;
+        dst->gravity = f->config->fieldHeight;
         dst->extra |= FST_INPUT_HARD_DROP;
         dst->extra |= FST_INPUT_LOCK;
     }
@@ -124,3 +58,167 @@ void fsVirtualKeysToInput(FSInput *dst, u32 keys, const FSEngine *f, FSControl *
         dst->extra |= FST_INPUT_QUIT;
     }
 }
+
+///
+// Return the direction of the held movement keys. Left takes priority.
+///
+static i8 heldDirection(u32 keys)
+{
+    if (keys & FST_VK_FLAG_LEFT) {
+        return -1;
+    }
+    if (keys & FST_VK_FLAG_RIGHT) {
+        return 1;
+    }
+    return 0;
+}
+
+///
+// Return the number of auto shift moves made by the time the movement key has
+// been held for `held` microseconds.
+///
+static i32 dasMoves(const FSEngine *f, i32 held)
+{
+    const i32 delay = f->config->dasDelay * 1000;
+
+    if (held < delay) {
+        return 0;
+    }
+
+    return (held - delay) / f->config->dasSpeed + 1;
+}
+
+///
+// Advance DAS by `elapsed` microseconds of the movement key being held and
+// return the movement it generates.
+//
+// Every auto shift move which falls within the elapsed time is returned at
+// once, so an ARR shorter than a tick moves multiple cells per tick.
+///
+static i8 dasShift(const FSEngine *f, FSControl *c, i32 elapsed)
+{
+    const i32 delay = f->config->dasDelay * 1000;
+    const i32 speed = f->config->dasSpeed;
+    const i32 width = f->config->fieldWidth;
+
+    if (c->dasDirection == 0 || elapsed <= 0) {
+        return 0;
+    }
+
+    const i32 before = c->dasCounter;
+    c->dasCounter += elapsed;
+    if (c->dasCounter < delay) {
+        return 0;
+    }
+
+    // Instant auto shift.
+    if (speed == 0) {
+        c->dasCounter = delay;
+        return c->dasDirection * width;
+    }
+
+    i32 cells = dasMoves(f, c->dasCounter) - dasMoves(f, before);
+
+    // Keep the counter bounded while preserving the time until the next move.
+    c->dasCounter = delay + (c->dasCounter - delay) % speed;
+
+    if (cells > width) {
+        cells = width;
+    }
+    return c->dasDirection * cells;
+}
+
+///
+// Start DAS in a new direction if the held movement keys changed, returning
+// the initial single cell move.
+///
+static i8 dasStart(FSControl *c, u32 keys)
+{
+    const i8 direction = heldDirection(keys);
+
+    if (direction == c->dasDirection) {
+        return 0;
+    }
+
+    c->dasDirection = direction;
+    c->dasCounter = 0;
+    return direction;
+}
+
+///
+// Transform the current input state into a simple set of actions for the
+// engine to apply.
+//
+// `keys` is an integer with bits set depending on the state of the specified
+//  key. The bits set correspond to the `FST_VK_FLAG` enum in `fsControl.h`.
+//
+// DAS is charged for the rest of the tick, measured in microseconds so the
+// delay and repeat rate do not depend on the tick length.
+///
+void fsVirtualKeysToInput(FSInput *dst, u32 keys, const FSEngine *f, FSControl *c)
+{
+    u32 lastTickKeys = c->lastKeys;
+    u32 newKeys = keys & ~lastTickKeys;
+    c->lastKeys = keys;
+
+    c->currentKeys &= keys;
+    keys &= ~c->currentKeys;
+    newKeys &= keys;
+    dst->currentKeys = keys;
+    dst->newKeysCount = popcount(newKeys);
+
+    // Changes seen here occurred at the start of the tick, so a new direction
+    // is held for all of it.
+    i32 movement = dasStart(c, keys);
+    movement += dasShift(f, c, f->config->msPerTick * 1000 - c->tickTime);
+    c->tickTime = 0;
+
+    if (movement < -f->config->fieldWidth) {
+        movement = -f->config->fieldWidth;
+    }
+    if (movement > f->config->fieldWidth) {
+        movement = f->config->fieldWidth;
+    }
+    dst->movement = movement;
+
+    const int sdKeysToCheck = f->config->oneShotSoftDrop ? newKeys : keys;
+    if (sdKeysToCheck & FST_VK_FLAG_DOWN) {
+        dst->softDrop = f->config->msPerTick * f->config->softDropGravity;
+    }
+
+    applyNewKeys(dst, newKeys, f);
+}
+
+///
+// Transform a change in key state part way through a tick into the actions it
+// should perform immediately.
+//
+// `time` is the microseconds since the start of the tick. DAS is charged up to
+// that point in the previously held direction before the change is applied, so
+// a new left or right press moves a single cell and restarts DAS at the time
+// it occurred. Calling this first with the unchanged keys only advances DAS,
+// which keeps the auto shift separate from the move of the change itself.
+///
+void fsVirtualKeysToPartialInput(FSInput *dst, u32 keys, i32 time,
+                                 const FSEngine *f, FSControl *c)
+{
+    u32 newKeys = keys & ~c->lastKeys;
+    c->lastKeys = keys;
+
+    dst->movement = dasShift(f, c, time - c->tickTime);
+    c->tickTime = time;
+
+    c->currentKeys &= keys;
+    keys &= ~c->currentKeys;
+    newKeys &= keys;
+    dst->currentKeys = keys;
+    dst->newKeysCount = popcount(newKeys);
+
+    dst->movement += dasStart(c, keys);
+
+    if (f->config->oneShotSoftDrop && (newKeys & FST_VK_FLAG_DOWN)) {
+        dst->softDrop = f->config->msPerTick * f->config->softDropGravity;
+    }
+
+    applyNewKeys(dst, newKeys, f);
+}
@@ -61,6 +61,39 @@ enum VirtualKey {
     FST_VK_FLAG_QUIT    = (1 << FST_VK_QUIT)
 };
 
+// A change in the set of pressed virtual keys.
+//
+// Frontends which receive input as events timestamp each change when it
+// occurred, so changes made between two ticks keep their order and spacing.
+struct FSKeyEvent {
+    /// Time of the change in microseconds, on the `fsiGetTime` clock.
+    //
+    // Replays store the time relative to the start of the tick instead.
+    i32 time;
+
+    /// Virtual keys pressed after this change.
+    u32 keys;
+};
+
+///
+// Return the microseconds from time `b` to time `a` on the `fsiGetTime` clock.
+//
+// The clock wraps around, so times must only be compared by their difference.
+// This is computed unsigned since signed overflow is undefined.
+///
+static inline i32 fsTimeDiff(i32 a, i32 b)
+{
+    return (i32) ((u32) a - (u32) b);
+}
+
+///
+// Return the time `us` microseconds after time `t` on the `fsiGetTime` clock.
+///
+static inline i32 fsTimeAdd(i32 t, i32 us)
+{
+    return (i32) ((u32) t + (u32) us);
+}
+
 // This handles cross-key state required during generation of `FSInput` values.
 struct FSControl {
     /// @I: State of input device last tick.
@@ -69,8 +102,16 @@ struct FSControl {
     /// @I: Current state of input device.
     u32 currentKeys;
 
-    /// @I: Number of ticks DAS has occurred for.
+    /// @I: Microseconds the movement key has been held for.
+    //
+    // Once auto shift begins this only keeps the time since the last move.
     i32 dasCounter;
+
+    /// @I: Microseconds into the current tick of the last conversion.
+    i32 tickTime;
+
+    /// @I: Direction of the held movement key. -1 for left, 1 for right.
+    i8 dasDirection;
 };
 
 // Generation target for `FSControl` which the `FSEngine` can understand.
@@ -86,7 +127,7 @@ struct FSInput {
     // Positive movement indicates a right move, whilst negative is left.
     i8 movement;
 
-    /// Downward movement action. Product of gravity and soft drop.
+    /// Downward movement action in whole rows, such as a hard drop.
     i8 gravity;
 
     /// Specific extra movement (e.g. HardDrop).
@@ -97,10 +138,21 @@ struct FSInput {
 
     /// Current key status (used for some specific events)
     u32 currentKeys;
+
+    /// Soft drop distance in fixed point rows.
+    //
+    // This is kept apart from `gravity` so soft drop slower than a row per
+    // tick still moves the piece when ticks are short.
+    i32 softDrop;
 };
 
 // Converts the current keystate `keys` with the state object `c` into the
 // associated `FSInput` output structure.
 void fsVirtualKeysToInput(FSInput *dst, u32 keys, const FSEngine *f, FSControl *c);
 
+// Converts a key change occurring part way through a tick into the actions
+// which apply immediately. The tick is completed with `fsVirtualKeysToInput`.
+void fsVirtualKeysToPartialInput(FSInput *dst, u32 keys, i32 time,
+                                 const FSEngine *f, FSControl *c);
+
 #endif // FS_CONTROL_H
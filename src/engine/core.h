@@ -15,14 +15,26 @@
 // anywhere else (as a struct, too). This is cleaner, and works much better
 // due to all the cyclical dependencies between these structures.
 typedef struct FSEngine FSEngine;
+typedef struct FSEngineConfig FSEngineConfig;
 typedef struct FSInput FSInput;
 typedef struct FSControl FSControl;
+typedef struct FSKeyEvent FSKeyEvent;
 typedef struct FSView FSView;
 typedef struct FSFrontend FSFrontend;
 typedef struct FSOptions FSOptions;
 typedef struct FSDao FSDao;
+typedef struct FSReplayEvent FSReplayEvent;
+typedef struct FSDaoRecord FSDaoRecord;
 typedef struct FSRotationSystem FSRotationSystem;
 typedef struct FSRandCtx FSRandCtx;
+typedef struct FSRandState FSRandState;
+typedef struct FSRandLanes FSRandLanes;
+typedef struct FSGameStats FSGameStats;
+typedef struct FSEngineSnapshot FSEngineSnapshot;
+typedef struct FSSnapshotRing FSSnapshotRing;
+typedef struct FSPlacement FSPlacement;
+typedef struct FSLatency FSLatency;
+typedef struct FSLatencyHistogram FSLatencyHistogram;
 
 // (N)umber of (P)iece (T)ypes.
 #define FS_NPT 7
@@ -54,6 +66,8 @@ enum PieceType {
 
 typedef int8_t FSBlock;
 typedef int8_t i8;
+typedef uint8_t u8;
+typedef int16_t i16;
 typedef int32_t i32;
 typedef uint32_t u32;
 
@@ -3,12 +3,28 @@
 // daoInit(&dao);
 //
 // daoInsertReplayOverview(&dao);
-// daoInsertReplayInput(&dao, 1, 0x45);
+// daoInsertReplayInput(&dao, 1, 0, 0x45);
 // daoMarkReplayComplete(&dao);
 // ```
+//
+// Writes are performed by a worker thread so the game never waits on the
+// disk. Each call queues a fixed-size record in a single-producer,
+// single-consumer ring; the worker drains whatever is queued in one
+// transaction. The database uses a write-ahead log with `synchronous=NORMAL`,
+// so these commits append to the log without waiting for an fsync.
+//
+// The key changes of a replay are stored as a single blob in the encoding of
+// replay.h. Replays recorded before this kept a row per change in
+// `replay_input`, which is still read if a replay has no blob.
+//
+// Only the game thread may call the `dao*` functions.
 
+#define _POSIX_C_SOURCE 200112L
+
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <sqlite3.h>
 
 #include "core.h"
@@ -26,9 +42,26 @@
 
 #define DAO_FILENAME "fs.db"
 
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+// Number of key changes after which the replay being recorded is saved, so a
+// crash loses at most this many.
+#define DAO_CHECKPOINT_CHANGES 256
+
+// How long the worker sleeps when there is nothing to write.
+#define DAO_WORKER_IDLE_US 5000
+
+// Queue positions are shared between the threads with acquire/release
+// ordering so a record is complete before its position is seen.
+#define LOAD(x) __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+#define STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
 static void setupHiscoreTable(FSDao *dao);
 static void setupReplayOverviewTable(FSDao *dao);
 static void setupReplayInputTable(FSDao *dao);
+static void setupReplayDataTable(FSDao *dao);
+static void *runWorker(void *arg);
 
 // Resolves the db file to load.
 //
@@ -92,13 +125,134 @@ void daoInit(FSDao *dao)
         exit(1);
     }
 
+    // Not every filesystem supports WAL, in which case the default rollback
+    // journal is kept. Reads are memory mapped so loading a replay blob does
+    // not copy it through the page cache.
+    const char pragma_stmt[] =
+        "pragma journal_mode=WAL;"
+        "pragma synchronous=NORMAL;"
+        "pragma mmap_size=268435456;";
+
+    if (sqlite3_exec(dao->db, pragma_stmt, NULL, NULL, NULL) != SQLITE_OK) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+
     setupHiscoreTable(dao);
     setupReplayOverviewTable(dao);
     setupReplayInputTable(dao);
+    setupReplayDataTable(dao);
+
+    dao->queue_head = 0;
+    dao->queue_tail = 0;
+    dao->queue_committed = 0;
+    dao->overflow = NULL;
+    dao->overflow_start = 0;
+    dao->overflow_count = 0;
+    dao->overflow_capacity = 0;
+    dao->dropped = 0;
+
+    if (pthread_create(&dao->worker, NULL, runWorker, dao) != 0) {
+        fsLogFatal("failed to create database worker");
+        exit(1);
+    }
+}
+
+static void sleepUs(long us)
+{
+    struct timespec ts = { us / 1000000, (us % 1000000) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+///
+// Move records from the overflow buffer to the queue in order, as far as
+// there is space.
+///
+static void drainOverflow(FSDao *dao)
+{
+    const u32 tail = LOAD(dao->queue_tail);
+    u32 head = dao->queue_head;
+
+    if (dao->overflow_start == dao->overflow_count) {
+        return;
+    }
+
+    while (dao->overflow_start < dao->overflow_count && head - tail != DAO_QUEUE_SIZE) {
+        dao->queue[head & (DAO_QUEUE_SIZE - 1)] = dao->overflow[dao->overflow_start++];
+        head += 1;
+    }
+
+    if (dao->overflow_start == dao->overflow_count) {
+        dao->overflow_start = 0;
+        dao->overflow_count = 0;
+    }
+
+    STORE(dao->queue_head, head);
+}
+
+///
+// Queue a record for the worker.
+//
+// This never waits. If the worker falls `DAO_QUEUE_SIZE` records behind, the
+// record is kept in the overflow buffer until the queue has space, so a slow
+// disk never stalls the game. It is only dropped if the buffer cannot grow.
+///
+static void push(FSDao *dao, const FSDaoRecord *r)
+{
+    drainOverflow(dao);
+
+    const u32 head = dao->queue_head;
+
+    if (dao->overflow_count == 0 && head - LOAD(dao->queue_tail) != DAO_QUEUE_SIZE) {
+        dao->queue[head & (DAO_QUEUE_SIZE - 1)] = *r;
+        STORE(dao->queue_head, head + 1);
+        return;
+    }
+
+    if (dao->overflow_count == dao->overflow_capacity) {
+        const i32 capacity = dao->overflow_capacity ? 2 * dao->overflow_capacity
+                                                    : DAO_QUEUE_SIZE;
+        FSDaoRecord *overflow = realloc(dao->overflow, capacity * sizeof(FSDaoRecord));
+
+        if (!overflow) {
+            if (dao->dropped++ == 0) {
+                fsLogWarning("database queue full, dropping records");
+            }
+            return;
+        }
+
+        if (dao->overflow_capacity == 0) {
+            fsLogWarning("database queue full, buffering records");
+        }
+
+        dao->overflow = overflow;
+        dao->overflow_capacity = capacity;
+    }
+
+    dao->overflow[dao->overflow_count++] = *r;
+}
+
+// Wait until every queued record has been committed.
+void daoFlush(FSDao *dao)
+{
+    while (dao->overflow_count != 0 || LOAD(dao->queue_committed) != dao->queue_head) {
+        drainOverflow(dao);
+        sleepUs(DAO_WORKER_IDLE_US / 5);
+    }
 }
 
 void daoDeinit(FSDao *dao)
 {
+    const FSDaoRecord stop = { .type = FST_DAO_STOP };
+
+    // The queue is empty once flushed, so the stop record always fits.
+    daoFlush(dao);
+    push(dao, &stop);
+    pthread_join(dao->worker, NULL);
+
+    if (dao->dropped) {
+        fsLogWarning("%u database records were dropped", dao->dropped);
+    }
+
     if (sqlite3_finalize(dao->hiscore_stmt) != SQLITE_OK) {
         fsLogWarning("%s", sqlite3_errmsg(dao->db));
     }
@@ -107,17 +261,45 @@ void daoDeinit(FSDao *dao)
         fsLogWarning("%s", sqlite3_errmsg(dao->db));
     }
 
+    if (sqlite3_finalize(dao->replay_overview_select_stmt) != SQLITE_OK) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+
     if (sqlite3_finalize(dao->replay_overview_complete_stmt) != SQLITE_OK) {
         fsLogWarning("%s", sqlite3_errmsg(dao->db));
     }
 
-    if (sqlite3_finalize(dao->replay_input_stmt) != SQLITE_OK) {
+    if (sqlite3_finalize(dao->replay_output_stmt) != SQLITE_OK) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+
+    if (sqlite3_finalize(dao->replay_data_stmt) != SQLITE_OK) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+
+    if (sqlite3_finalize(dao->replay_data_select_stmt) != SQLITE_OK) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+
+    if (sqlite3_finalize(dao->replay_chunk_stmt) != SQLITE_OK) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+
+    if (sqlite3_finalize(dao->replay_chunk_select_stmt) != SQLITE_OK) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+
+    if (sqlite3_finalize(dao->replay_chunk_delete_stmt) != SQLITE_OK) {
         fsLogWarning("%s", sqlite3_errmsg(dao->db));
     }
 
     if (sqlite3_close(dao->db) != SQLITE_OK) {
         fsLogWarning("%s", sqlite3_errmsg(dao->db));
     }
+
+    free(dao->replay_events);
+    free(dao->replay_data);
+    free(dao->overflow);
 }
 
 // If new hiscore fields are added in the future, previously unknown fields
@@ -160,15 +342,26 @@ static void setupHiscoreTable(FSDao *dao)
 }
 
 void daoSaveHiscore(FSDao *dao, const FSEngine *f)
+{
+    FSDaoRecord r = { .type = FST_DAO_HISCORE };
+
+    r.data.hiscore.msElapsed = f->config->msPerTick * f->totalTicks;
+    r.data.hiscore.blocksPlaced = f->blocksPlaced;
+    r.data.hiscore.totalKeysPressed = f->totalKeysPressed;
+    r.data.hiscore.goal = f->config->goal;
+    push(dao, &r);
+}
+
+static void writeHiscore(FSDao *dao, const FSDaoRecord *r)
 {
     sqlite3_stmt *s = dao->hiscore_stmt;
-    const int msElapsed = f->msPerTick * f->totalTicks;
+    const int msElapsed = r->data.hiscore.msElapsed;
 
     sqlite3_bind_int(s, 1, dao->replay_overview_row_id);
     sqlite3_bind_double(s, 2, (double) msElapsed / 1000);
-    sqlite3_bind_double(s, 3, (double) f->blocksPlaced / ((double) msElapsed / 1000));
-    sqlite3_bind_double(s, 4, (double) f->totalKeysPressed / f->blocksPlaced);
-    sqlite3_bind_int(s, 5, f->goal);
+    sqlite3_bind_double(s, 3, (double) r->data.hiscore.blocksPlaced / ((double) msElapsed / 1000));
+    sqlite3_bind_double(s, 4, (double) r->data.hiscore.totalKeysPressed / r->data.hiscore.blocksPlaced);
+    sqlite3_bind_int(s, 5, r->data.hiscore.goal);
 
     sqlite3_step(s);
     sqlite3_clear_bindings(s);
@@ -249,7 +442,7 @@ static void setupReplayOverviewTable(FSDao *dao)
         "values"
         "("
             "datetime(\"now\"),"
-            "1,"
+            STR(DAO_REPLAY_VERSION) ","
             "0,"
             "?,"
             "?,"
@@ -320,11 +513,10 @@ static void setupReplayOverviewTable(FSDao *dao)
     }
 }
 
-// NOTE: Current storage means reads every frame to check if the tick
-// is accessed.
-//
-// These could be buffered however to perform only every second or so easily
-// so don't worry about changing format right now.
+// Each row is a key change of a replay recorded before replay blobs. This is
+// only read. `tick_time` is when the change occurred in microseconds from the
+// start of the tick it applies to. Databases created before it existed have
+// it added, with older changes occurring at the start of their tick.
 static void setupReplayInputTable(FSDao *dao)
 {
     const char create_stmt[] =
@@ -333,7 +525,8 @@ static void setupReplayInputTable(FSDao *dao)
             "id INTEGER PRIMARY KEY,"
             "replay_id INTEGER REFERENCES replay_overview(id),"
             "tick INTEGER,"
-            "keystate INTEGER"
+            "keystate INTEGER,"
+            "tick_time INTEGER DEFAULT 0"
         ");";
 
     if (sqlite3_exec(dao->db, create_stmt, NULL, NULL, NULL) != SQLITE_OK) {
@@ -341,25 +534,86 @@ static void setupReplayInputTable(FSDao *dao)
         exit(1);
     }
 
-    const char insert_stmt[] =
-        "insert into replay_input"
+    const char check_stmt[] = "select tick_time from replay_input limit 0;";
+    const char alter_stmt[] =
+        "alter table replay_input add column tick_time INTEGER DEFAULT 0;";
+
+    if (sqlite3_exec(dao->db, check_stmt, NULL, NULL, NULL) != SQLITE_OK &&
+            sqlite3_exec(dao->db, alter_stmt, NULL, NULL, NULL) != SQLITE_OK) {
+        fsLogFatal("%s", sqlite3_errmsg(dao->db));
+        exit(1);
+    }
+
+    // A replay is loaded in a single query, which this keeps from scanning
+    // every other replay.
+    const char index_stmt[] =
+        "create index if not exists replay_input_replay_id "
+        "on replay_input(replay_id);";
+
+    if (sqlite3_exec(dao->db, index_stmt, NULL, NULL, NULL) != SQLITE_OK) {
+        fsLogFatal("%s", sqlite3_errmsg(dao->db));
+        exit(1);
+    }
+
+    const char get_stmt[] =
+        "select tick, tick_time, keystate from replay_input "
+        "where replay_id = ? order by id;";
+
+    if (sqlite3_prepare_v2(
+            dao->db,
+            get_stmt,
+            sizeof(get_stmt),
+            &dao->replay_output_stmt,
+            NULL
+        ) != SQLITE_OK)
+    {
+        fsLogFatal("%s", sqlite3_errmsg(dao->db));
+        exit(1);
+    }
+
+    dao->last_input_keystate = 0;
+    dao->last_output_keystate = 0;
+
+    dao->replay_events = NULL;
+    dao->replay_event_count = 0;
+    dao->replay_event_capacity = 0;
+    dao->replay_event_cursor = 0;
+}
+
+// One row per complete replay holding its header and every key change.
+//
+// A replay being recorded is instead appended to `replay_chunk` at each
+// checkpoint, so each byte is written once. The chunks are joined into a
+// single `replay_data` row when the replay completes.
+static void setupReplayDataTable(FSDao *dao)
+{
+    const char create_stmt[] =
+        "create table if not exists replay_data"
         "("
-            "replay_id,"
-            "tick,"
-            "keystate"
-        ")"
-        "values"
+            "replay_id INTEGER PRIMARY KEY REFERENCES replay_overview(id),"
+            "data BLOB"
+        ");"
+        "create table if not exists replay_chunk"
         "("
-            "?,"
-            "?,"
-            "?"
+            "replay_id INTEGER REFERENCES replay_overview(id),"
+            "seq INTEGER,"
+            "data BLOB,"
+            "PRIMARY KEY (replay_id, seq)"
         ");";
 
+    if (sqlite3_exec(dao->db, create_stmt, NULL, NULL, NULL) != SQLITE_OK) {
+        fsLogFatal("%s", sqlite3_errmsg(dao->db));
+        exit(1);
+    }
+
+    const char insert_stmt[] =
+        "insert or replace into replay_data (replay_id, data) values (?, ?);";
+
     if (sqlite3_prepare_v2(
             dao->db,
             insert_stmt,
             sizeof(insert_stmt),
-            &dao->replay_input_stmt,
+            &dao->replay_data_stmt,
             NULL
         ) != SQLITE_OK)
     {
@@ -367,15 +621,14 @@ static void setupReplayInputTable(FSDao *dao)
         exit(1);
     }
 
-    const char get_stmt[] =
-        "select keystate from replay_input "
-        "where replay_id = ? and tick = ?;";
+    const char select_stmt[] =
+        "select data from replay_data where replay_id = ?;";
 
     if (sqlite3_prepare_v2(
             dao->db,
-            get_stmt,
-            sizeof(get_stmt),
-            &dao->replay_output_stmt,
+            select_stmt,
+            sizeof(select_stmt),
+            &dao->replay_data_select_stmt,
             NULL
         ) != SQLITE_OK)
     {
@@ -383,67 +636,264 @@ static void setupReplayInputTable(FSDao *dao)
         exit(1);
     }
 
-    dao->last_input_keystate = 0;
-    dao->last_output_keystate = 0;
+    const char chunk_insert_stmt[] =
+        "insert or replace into replay_chunk (replay_id, seq, data) values (?, ?, ?);";
+
+    if (sqlite3_prepare_v2(
+            dao->db,
+            chunk_insert_stmt,
+            sizeof(chunk_insert_stmt),
+            &dao->replay_chunk_stmt,
+            NULL
+        ) != SQLITE_OK)
+    {
+        fsLogFatal("%s", sqlite3_errmsg(dao->db));
+        exit(1);
+    }
+
+    const char chunk_select_stmt[] =
+        "select data from replay_chunk where replay_id = ? order by seq;";
+
+    if (sqlite3_prepare_v2(
+            dao->db,
+            chunk_select_stmt,
+            sizeof(chunk_select_stmt),
+            &dao->replay_chunk_select_stmt,
+            NULL
+        ) != SQLITE_OK)
+    {
+        fsLogFatal("%s", sqlite3_errmsg(dao->db));
+        exit(1);
+    }
+
+    const char chunk_delete_stmt[] =
+        "delete from replay_chunk where replay_id = ?;";
+
+    if (sqlite3_prepare_v2(
+            dao->db,
+            chunk_delete_stmt,
+            sizeof(chunk_delete_stmt),
+            &dao->replay_chunk_delete_stmt,
+            NULL
+        ) != SQLITE_OK)
+    {
+        fsLogFatal("%s", sqlite3_errmsg(dao->db));
+        exit(1);
+    }
+
+    dao->replay_data = NULL;
+    dao->replay_data_length = 0;
+    dao->replay_data_capacity = 0;
+    dao->replay_data_unsaved = 0;
+    dao->replay_data_saved = 0;
+    dao->replay_data_chunks = 0;
+}
+
+// Ensure the replay being recorded has room for `length` more bytes.
+static void reserveReplayData(FSDao *dao, i32 length)
+{
+    if (dao->replay_data_length + length <= dao->replay_data_capacity) {
+        return;
+    }
+
+    i32 capacity = dao->replay_data_capacity ? dao->replay_data_capacity : 4096;
+    while (capacity < dao->replay_data_length + length) {
+        capacity *= 2;
+    }
+
+    u8 *data = realloc(dao->replay_data, capacity);
+    if (!data) {
+        fsLogFatal("out of memory recording replay");
+        exit(1);
+    }
+
+    dao->replay_data = data;
+    dao->replay_data_capacity = capacity;
+}
+
+// Append the bytes of the replay being recorded which have not been written
+// yet as its next chunk.
+static void saveReplayChunk(FSDao *dao)
+{
+    sqlite3_stmt *s = dao->replay_chunk_stmt;
+
+    if (dao->replay_data_saved == dao->replay_data_length) {
+        return;
+    }
+
+    sqlite3_bind_int(s, 1, dao->replay_overview_row_id);
+    sqlite3_bind_int(s, 2, dao->replay_data_chunks);
+    sqlite3_bind_blob(s, 3, &dao->replay_data[dao->replay_data_saved],
+                      dao->replay_data_length - dao->replay_data_saved, SQLITE_STATIC);
+
+    if (sqlite3_step(s) != SQLITE_DONE) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+    sqlite3_clear_bindings(s);
+    sqlite3_reset(s);
+
+    dao->replay_data_unsaved = 0;
+    dao->replay_data_saved = dao->replay_data_length;
+    dao->replay_data_chunks += 1;
+}
+
+// Write the whole replay being recorded as one row and drop its chunks. Only
+// done once the replay is complete.
+static void saveReplayData(FSDao *dao)
+{
+    sqlite3_stmt *s = dao->replay_data_stmt;
+
+    sqlite3_bind_int(s, 1, dao->replay_overview_row_id);
+    sqlite3_bind_blob(s, 2, dao->replay_data, dao->replay_data_length, SQLITE_STATIC);
+
+    if (sqlite3_step(s) != SQLITE_DONE) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+    sqlite3_clear_bindings(s);
+    sqlite3_reset(s);
+
+    s = dao->replay_chunk_delete_stmt;
+    sqlite3_bind_int(s, 1, dao->replay_overview_row_id);
+
+    if (sqlite3_step(s) != SQLITE_DONE) {
+        fsLogWarning("%s", sqlite3_errmsg(dao->db));
+    }
+    sqlite3_clear_bindings(s);
+    sqlite3_reset(s);
+
+    dao->replay_data_unsaved = 0;
+    dao->replay_data_saved = dao->replay_data_length;
 }
 
 void daoInsertReplayOverview(FSDao *dao, const FSEngine *f)
 {
-    sqlite3_stmt *s = dao->replay_overview_stmt;
+    FSDaoRecord r = { .type = FST_DAO_REPLAY_OVERVIEW };
+
+    r.data.overview.seed = f->seed;
+    r.data.overview.config = *f->config;
+    push(dao, &r);
+
+    // Playback starts with no keys held, so the first change of a replay must
+    // be stored even if it matches the last change of the previous one.
+    dao->last_input_keystate = 0;
+}
 
-    sqlite3_bind_int(s,  1, f->seed);
-    sqlite3_bind_int(s,  2, f->goal);
-    sqlite3_bind_int(s,  3, f->fieldWidth);
-    sqlite3_bind_int(s,  4, f->fieldHeight);
-    sqlite3_bind_int(s,  5, f->fieldHidden);
-    sqlite3_bind_int(s,  6, f->initialActionStyle);
-    sqlite3_bind_int(s,  7, f->dasSpeed);
-    sqlite3_bind_int(s,  8, f->dasDelay);
-    sqlite3_bind_int(s,  9, f->msPerTick);
-    sqlite3_bind_int(s, 10, f->ticksPerDraw);
-    sqlite3_bind_int(s, 11, f->areDelay);
-    sqlite3_bind_int(s, 12, f->areCancellable);
-    sqlite3_bind_int(s, 13, f->lockStyle);
-    sqlite3_bind_int(s, 14, f->lockDelay);
-    sqlite3_bind_int(s, 15, f->floorkickLimit);
-    sqlite3_bind_int(s, 16, f->oneShotSoftDrop);
-    sqlite3_bind_int(s, 17, f->rotationSystem);
-    sqlite3_bind_int(s, 18, f->gravity);
-    sqlite3_bind_int(s, 19, f->softDropGravity);
-    sqlite3_bind_int(s, 20, f->randomizer);
-    sqlite3_bind_int(s, 21, f->readyPhaseLength);
-    sqlite3_bind_int(s, 22, f->goPhaseLength);
-    sqlite3_bind_int(s, 23, f->infiniteReadyGoHold);
-    sqlite3_bind_int(s, 24, f->nextPieceCount);
+static void writeReplayOverview(FSDao *dao, const FSDaoRecord *r)
+{
+    sqlite3_stmt *s = dao->replay_overview_stmt;
+    const FSEngineConfig *c = &r->data.overview.config;
+
+    // Finish the previous replay before starting this one.
+    saveReplayChunk(dao);
+
+    sqlite3_bind_int(s,  1, r->data.overview.seed);
+    sqlite3_bind_int(s,  2, c->goal);
+    sqlite3_bind_int(s,  3, c->fieldWidth);
+    sqlite3_bind_int(s,  4, c->fieldHeight);
+    sqlite3_bind_int(s,  5, c->fieldHidden);
+    sqlite3_bind_int(s,  6, c->initialActionStyle);
+    sqlite3_bind_int(s,  7, c->dasSpeed);
+    sqlite3_bind_int(s,  8, c->dasDelay);
+    sqlite3_bind_int(s,  9, c->msPerTick);
+    sqlite3_bind_int(s, 10, c->ticksPerDraw);
+    sqlite3_bind_int(s, 11, c->areDelay);
+    sqlite3_bind_int(s, 12, c->areCancellable);
+    sqlite3_bind_int(s, 13, c->lockStyle);
+    sqlite3_bind_int(s, 14, c->lockDelay);
+    sqlite3_bind_int(s, 15, c->floorkickLimit);
+    sqlite3_bind_int(s, 16, c->oneShotSoftDrop);
+    sqlite3_bind_int(s, 17, c->rotationSystem);
+    sqlite3_bind_int(s, 18, c->gravity);
+    sqlite3_bind_int(s, 19, c->softDropGravity);
+    sqlite3_bind_int(s, 20, c->randomizer);
+    sqlite3_bind_int(s, 21, c->readyPhaseLength);
+    sqlite3_bind_int(s, 22, c->goPhaseLength);
+    sqlite3_bind_int(s, 23, c->infiniteReadyGoHold);
+    sqlite3_bind_int(s, 24, c->nextPieceCount);
 
     sqlite3_step(s);
     sqlite3_clear_bindings(s);
     sqlite3_reset(s);
 
     dao->replay_overview_row_id = sqlite3_last_insert_rowid(dao->db);
+
+    reserveReplayData(dao, FS_REPLAY_HEADER_MAX);
+    dao->replay_data_length = fsReplayEncodeHeader(dao->replay_data, r->data.overview.seed, c);
+    memset(&dao->replay_data_last, 0, sizeof(dao->replay_data_last));
+    dao->replay_data_unsaved = 0;
+    dao->replay_data_saved = 0;
+    dao->replay_data_chunks = 0;
 }
 
-void daoInsertReplayInput(FSDao *dao, u32 ticks, u32 keystate)
+void daoInsertReplayInput(FSDao *dao, u32 ticks, i32 time, u32 keystate)
 {
     // Only store deltas and not each state.
     if (dao->last_input_keystate == keystate) {
         return;
     }
 
-    sqlite3_stmt *s = dao->replay_input_stmt;
-
-    sqlite3_bind_int(s, 1, dao->replay_overview_row_id);
-    sqlite3_bind_int(s, 2, ticks);
-    sqlite3_bind_int(s, 3, keystate);
+    FSDaoRecord r = { .type = FST_DAO_REPLAY_INPUT };
 
-    sqlite3_step(s);
-    sqlite3_clear_bindings(s);
-    sqlite3_reset(s);
+    r.data.input.tick = ticks;
+    r.data.input.time = time;
+    r.data.input.keys = keystate;
+    push(dao, &r);
 
     dao->last_input_keystate = keystate;
 }
 
-static void daoLoadReplayOverview(FSDao *dao, FSEngine *f, u32 replay_id)
+static void writeReplayInput(FSDao *dao, const FSDaoRecord *r)
+{
+    reserveReplayData(dao, FS_REPLAY_EVENT_MAX);
+    dao->replay_data_length += fsReplayEncodeEvent(
+        &dao->replay_data[dao->replay_data_length], &dao->replay_data_last, &r->data.input);
+    dao->replay_data_last = r->data.input;
+
+    if (++dao->replay_data_unsaved == DAO_CHECKPOINT_CHANGES) {
+        saveReplayChunk(dao);
+    }
+}
+
+// Read the seed and options of a row holding `replay_overview.*` from column
+// `first` onwards.
+void daoReadReplayOverview(sqlite3_stmt *s, int first, u32 *seed, FSEngineConfig *c)
+{
+    // Skip id, version, date and complete
+    *seed = sqlite3_column_int(s, first + 4);
+    c->goal = sqlite3_column_int(s, first + 5);
+    c->fieldWidth = sqlite3_column_int(s, first + 6);
+    c->fieldHeight = sqlite3_column_int(s, first + 7);
+    c->fieldHidden = sqlite3_column_int(s, first + 8);
+    c->initialActionStyle = sqlite3_column_int(s, first + 9);
+    c->dasSpeed = sqlite3_column_int(s, first + 10);
+    c->dasDelay = sqlite3_column_int(s, first + 11);
+    c->msPerTick = sqlite3_column_int(s, first + 12);
+    c->ticksPerDraw = sqlite3_column_int(s, first + 13);
+    c->areDelay = sqlite3_column_int(s, first + 14);
+    c->areCancellable = sqlite3_column_int(s, first + 15);
+    c->lockStyle = sqlite3_column_int(s, first + 16);
+    c->lockDelay = sqlite3_column_int(s, first + 17);
+    c->floorkickLimit = sqlite3_column_int(s, first + 18);
+    c->oneShotSoftDrop = sqlite3_column_int(s, first + 19);
+    c->rotationSystem = sqlite3_column_int(s, first + 20);
+    c->gravity = sqlite3_column_int(s, first + 21);
+    c->softDropGravity = sqlite3_column_int(s, first + 22);
+    c->randomizer = sqlite3_column_int(s, first + 23);
+    c->readyPhaseLength = sqlite3_column_int(s, first + 24);
+    c->goPhaseLength = sqlite3_column_int(s, first + 25);
+    c->infiniteReadyGoHold = sqlite3_column_int(s, first + 26);
+    c->nextPieceCount = sqlite3_column_int(s, first + 27);
+
+    // Version 1 replays stored the auto repeat rate in ticks, as the old
+    // `dasSpeed` option did.
+    if (sqlite3_column_int(s, first + 1) < 2) {
+        const long long arr = (long long) c->dasSpeed * c->msPerTick * 1000;
+        c->dasSpeed = arr < INT_MAX ? arr : INT_MAX;
+    }
+}
+
+static void daoLoadReplayOverview(FSDao *dao, FSEngine *f, FSEngineConfig *c,
+                                  u32 replay_id)
 {
     sqlite3_stmt *s = dao->replay_overview_select_stmt;
 
@@ -457,69 +907,271 @@ static void daoLoadReplayOverview(FSDao *dao, FSEngine *f, u32 replay_id)
         fsLogWarning("incomplete replay being played!");
     }
 
-    // Skip id, version, date and complete
-    f->seed = sqlite3_column_int(s, 4);
-    f->goal = sqlite3_column_int(s, 5);
-    f->fieldWidth = sqlite3_column_int(s, 6);
-    f->fieldHeight = sqlite3_column_int(s, 7);
-    f->fieldHidden = sqlite3_column_int(s, 8);
-    f->initialActionStyle = sqlite3_column_int(s, 9);
-    f->dasSpeed = sqlite3_column_int(s, 10);
-    f->dasDelay = sqlite3_column_int(s, 11);
-    f->msPerTick = sqlite3_column_int(s, 12);
-    f->ticksPerDraw = sqlite3_column_int(s, 13);
-    f->areDelay = sqlite3_column_int(s, 14);
-    f->areCancellable = sqlite3_column_int(s, 15);
-    f->lockStyle = sqlite3_column_int(s, 16);
-    f->lockDelay = sqlite3_column_int(s, 17);
-    f->floorkickLimit = sqlite3_column_int(s, 18);
-    f->oneShotSoftDrop = sqlite3_column_int(s, 19);
-    f->rotationSystem = sqlite3_column_int(s, 20);
-    f->gravity = sqlite3_column_int(s, 21);
-    f->softDropGravity = sqlite3_column_int(s, 22);
-    f->randomizer = sqlite3_column_int(s, 23);
-    f->readyPhaseLength = sqlite3_column_int(s, 24);
-    f->goPhaseLength = sqlite3_column_int(s, 25);
-    f->infiniteReadyGoHold = sqlite3_column_int(s, 26);
-    f->nextPieceCount = sqlite3_column_int(s, 27);
+    if (sqlite3_column_int(s, 1) < DAO_REPLAY_VERSION) {
+        fsLogWarning("replay from an older version may not play back correctly");
+    }
+
+    daoReadReplayOverview(s, 0, &f->seed, c);
 
     sqlite3_clear_bindings(s);
     sqlite3_reset(s);
 }
 
-void daoLoadReplay(FSDao *dao, FSEngine *f, u32 replay_id)
+// Return the next free entry of the loaded key changes.
+static FSReplayEvent *appendReplayEvent(FSDao *dao)
 {
-    daoLoadReplayOverview(dao, f, replay_id);
+    if (dao->replay_event_count == dao->replay_event_capacity) {
+        const i32 capacity = dao->replay_event_capacity ? 2 * dao->replay_event_capacity : 1024;
+        FSReplayEvent *events = realloc(dao->replay_events, capacity * sizeof(FSReplayEvent));
+        if (!events) {
+            fsLogFatal("out of memory loading replay");
+            exit(1);
+        }
 
-    dao->output_replay_id = replay_id;
-    dao->last_output_keystate = 0;
+        dao->replay_events = events;
+        dao->replay_event_capacity = capacity;
+    }
+
+    return &dao->replay_events[dao->replay_event_count++];
 }
 
-u32 daoGetReplayInput(FSDao *dao, u32 tick)
+// Decode the key changes of an encoded replay.
+static void decodeReplayData(FSDao *dao, u32 replay_id, const u8 *data, i32 length)
 {
-    sqlite3_stmt *s = dao->replay_output_stmt;
+    FSReplayEvent last = { 0, 0, 0 };
+    FSEngineConfig header;
+    u32 seed;
 
-    sqlite3_bind_int(s, 1, dao->output_replay_id);
-    sqlite3_bind_int(s, 2, tick);
+    i32 n = fsReplayDecodeHeader(data, length, &seed, &header);
+    if (n < 0) {
+        fsLogFatal("replay %d has an invalid header", replay_id);
+        exit(1);
+    }
+
+    while (n < length) {
+        FSReplayEvent *e = appendReplayEvent(dao);
+        const i32 r = fsReplayDecodeEvent(&data[n], length - n, &last, e);
+        if (r < 0) {
+            // A truncated replay still plays up to the last full change.
+            fsLogWarning("replay %d is truncated", replay_id);
+            dao->replay_event_count -= 1;
+            break;
+        }
+
+        last = *e;
+        n += r;
+    }
+}
+
+// Join the chunks of a replay which was not completed and decode them.
+// Returns false if the replay has no chunks.
+static bool daoLoadReplayChunks(FSDao *dao, u32 replay_id)
+{
+    sqlite3_stmt *s = dao->replay_chunk_select_stmt;
+    u8 *data = NULL;
+    i32 length = 0;
+    bool found = false;
+
+    sqlite3_bind_int(s, 1, replay_id);
+
+    while (sqlite3_step(s) == SQLITE_ROW) {
+        const u8 *chunk = sqlite3_column_blob(s, 0);
+        const i32 chunk_length = sqlite3_column_bytes(s, 0);
+
+        u8 *joined = realloc(data, length + chunk_length);
+        if (!joined) {
+            fsLogFatal("out of memory loading replay");
+            exit(1);
+        }
+
+        data = joined;
+        memcpy(&data[length], chunk, chunk_length);
+        length += chunk_length;
+        found = true;
+    }
+
+    sqlite3_clear_bindings(s);
+    sqlite3_reset(s);
+
+    if (found) {
+        decodeReplayData(dao, replay_id, data, length);
+    }
+
+    free(data);
+    return found;
+}
+
+// Decode the key changes of a replay blob, or of its chunks if it was not
+// completed. Returns false if the replay has neither.
+static bool daoLoadReplayData(FSDao *dao, u32 replay_id)
+{
+    sqlite3_stmt *s = dao->replay_data_select_stmt;
+    bool found = false;
+
+    sqlite3_bind_int(s, 1, replay_id);
 
     if (sqlite3_step(s) == SQLITE_ROW) {
-        dao->last_output_keystate = sqlite3_column_int(s, 0);
+        decodeReplayData(dao, replay_id, sqlite3_column_blob(s, 0), sqlite3_column_bytes(s, 0));
+        found = true;
     }
 
-    sqlite3_step(s);
     sqlite3_clear_bindings(s);
     sqlite3_reset(s);
 
-    return dao->last_output_keystate;
+    return found || daoLoadReplayChunks(dao, replay_id);
+}
+
+// Read every key change of a replay into memory. Replays without a blob use
+// their `replay_input` rows, which were inserted as they occurred so id order
+// is also tick order.
+static void daoLoadReplayEvents(FSDao *dao, u32 replay_id)
+{
+    sqlite3_stmt *s = dao->replay_output_stmt;
+
+    dao->replay_event_count = 0;
+    dao->replay_event_cursor = 0;
+
+    if (!daoLoadReplayData(dao, replay_id)) {
+        sqlite3_bind_int(s, 1, replay_id);
+
+        while (sqlite3_step(s) == SQLITE_ROW) {
+            FSReplayEvent *e = appendReplayEvent(dao);
+            e->tick = sqlite3_column_int(s, 0);
+            e->time = sqlite3_column_int(s, 1);
+            e->keys = sqlite3_column_int(s, 2);
+        }
+
+        sqlite3_clear_bindings(s);
+        sqlite3_reset(s);
+    }
+
+    fsLogInfo("loaded %d key changes for replay %d", dao->replay_event_count, replay_id);
+}
+
+void daoLoadReplay(FSDao *dao, FSEngine *f, FSEngineConfig *c, u32 replay_id)
+{
+    daoFlush(dao);
+    daoLoadReplayOverview(dao, f, c, replay_id);
+    daoLoadReplayEvents(dao, replay_id);
+
+    dao->output_replay_id = replay_id;
+    dao->last_output_keystate = 0;
+}
+
+// Ticks are normally requested in increasing order, so the cursor only moves
+// forward and each change is visited once. Requesting an earlier tick than
+// the last searches for it again.
+i32 daoGetReplayEvents(FSDao *dao, u32 tick, FSKeyEvent *dst, i32 capacity)
+{
+    const FSReplayEvent *events = dao->replay_events;
+    i32 i = dao->replay_event_cursor;
+    i32 count = 0;
+
+    if (i > 0 && events[i - 1].tick >= tick) {
+        i32 lo = 0;
+        i32 hi = i - 1;
+        while (lo < hi) {
+            const i32 mid = lo + (hi - lo) / 2;
+            if (events[mid].tick < tick) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        i = lo;
+    }
+
+    // Changes for ticks which were skipped are never played.
+    while (i < dao->replay_event_count && events[i].tick < tick) {
+        i += 1;
+    }
+
+    for (; i < dao->replay_event_count && events[i].tick == tick; ++i) {
+        dao->last_output_keystate = events[i].keys;
+
+        // Keep the final state if there are more changes than can be stored.
+        if (count == capacity) {
+            count -= 1;
+        }
+
+        dst[count].time = events[i].time;
+        dst[count].keys = events[i].keys;
+        count += 1;
+    }
+
+    dao->replay_event_cursor = i;
+    return count;
 }
 
 void daoMarkReplayComplete(FSDao *dao)
+{
+    const FSDaoRecord r = { .type = FST_DAO_REPLAY_COMPLETE };
+    push(dao, &r);
+}
+
+static void writeReplayComplete(FSDao *dao)
 {
     sqlite3_stmt *s = dao->replay_overview_complete_stmt;
 
+    saveReplayData(dao);
+
     sqlite3_bind_int(s, 1, dao->replay_overview_row_id);
 
     sqlite3_step(s);
     sqlite3_clear_bindings(s);
     sqlite3_reset(s);
 }
+
+static void *runWorker(void *arg)
+{
+    FSDao *dao = arg;
+    u32 tail = dao->queue_tail;
+    bool stop = false;
+
+    while (!stop) {
+        const u32 head = LOAD(dao->queue_head);
+
+        if (head == tail) {
+            sleepUs(DAO_WORKER_IDLE_US);
+            continue;
+        }
+
+        // Write everything queued so far as one transaction.
+        if (sqlite3_exec(dao->db, "begin;", NULL, NULL, NULL) != SQLITE_OK) {
+            fsLogWarning("%s", sqlite3_errmsg(dao->db));
+        }
+
+        for (; tail != head; ++tail) {
+            const FSDaoRecord *r = &dao->queue[tail & (DAO_QUEUE_SIZE - 1)];
+
+            switch (r->type) {
+                case FST_DAO_REPLAY_OVERVIEW:
+                    writeReplayOverview(dao, r);
+                    break;
+                case FST_DAO_REPLAY_INPUT:
+                    writeReplayInput(dao, r);
+                    break;
+                case FST_DAO_REPLAY_COMPLETE:
+                    writeReplayComplete(dao);
+                    break;
+                case FST_DAO_HISCORE:
+                    writeHiscore(dao, r);
+                    break;
+                case FST_DAO_STOP:
+                    saveReplayChunk(dao);
+                    stop = true;
+                    break;
+            }
+
+            STORE(dao->queue_tail, tail + 1);
+        }
+
+        if (sqlite3_exec(dao->db, "commit;", NULL, NULL, NULL) != SQLITE_OK) {
+            fsLogWarning("%s", sqlite3_errmsg(dao->db));
+        }
+
+        STORE(dao->queue_committed, tail);
+    }
+
+    return NULL;
+}
@@ -2,34 +2,123 @@
 #define FS_DAO_H
 
 #include "core.h"
+#include "engine.h"
+#include "replay.h"
+#include <pthread.h>
 #include <sqlite3.h>
 
+// Version of the replays written. Version 1 replays were recorded with DAS
+// counted in whole ticks, soft drop in whole rows and an older TGM3
+// sequence, so they may not play back identically. Their auto repeat rate is
+// converted from ticks when read.
+#define DAO_REPLAY_VERSION 2
+
+// Number of writes which can be queued for the worker. Must be a power of 2.
+#define DAO_QUEUE_SIZE 1024
+
+enum FSDaoRecordType {
+    FST_DAO_REPLAY_OVERVIEW,
+    FST_DAO_REPLAY_INPUT,
+    FST_DAO_REPLAY_COMPLETE,
+    FST_DAO_HISCORE,
+    FST_DAO_STOP
+};
+
+// A write queued for the worker thread.
+struct FSDaoRecord {
+    i8 type;
+
+    union {
+        struct {
+            u32 seed;
+            FSEngineConfig config;
+        } overview;
+
+        FSReplayEvent input;
+
+        struct {
+            i32 msElapsed;
+            i32 blocksPlaced;
+            i32 totalKeysPressed;
+            i32 goal;
+        } hiscore;
+    } data;
+};
+
 struct FSDao {
     sqlite3 *db;
     sqlite3_stmt *hiscore_stmt;
     sqlite3_stmt *replay_overview_stmt;
     sqlite3_stmt *replay_overview_select_stmt;
     sqlite3_stmt *replay_overview_complete_stmt;
-    sqlite3_stmt *replay_input_stmt;
     sqlite3_stmt *replay_output_stmt;
+    sqlite3_stmt *replay_data_stmt;
+    sqlite3_stmt *replay_data_select_stmt;
+    sqlite3_stmt *replay_chunk_stmt;
+    sqlite3_stmt *replay_chunk_select_stmt;
+    sqlite3_stmt *replay_chunk_delete_stmt;
 
     // NOTE: We can merge the following since one is used for input, the
     // other used during output.
+    //
+    // The row id is only used by the worker, the keystate by the game.
     u32 replay_overview_row_id;
     u32 last_input_keystate;
 
+    // Encoded replay being recorded by the worker, see replay.h. The first
+    // `replay_data_saved` bytes have been written as `replay_data_chunks`
+    // chunks.
+    u8 *replay_data;
+    i32 replay_data_length;
+    i32 replay_data_capacity;
+    FSReplayEvent replay_data_last;
+    i32 replay_data_unsaved;
+    i32 replay_data_saved;
+    i32 replay_data_chunks;
+
+    // Writes are queued by the game and performed in order by the worker.
+    // `queue_head` is only written by the game, `queue_tail` and
+    // `queue_committed` only by the worker, so no lock is needed.
+    pthread_t worker;
+    FSDaoRecord queue[DAO_QUEUE_SIZE];
+    u32 queue_head;
+
+    // Records which did not fit in the queue, in order, from `overflow_start`
+    // to `overflow_count`. These are only used by the game and are moved to
+    // the queue as the worker frees space. `dropped` counts records lost when
+    // the buffer could not grow.
+    FSDaoRecord *overflow;
+    i32 overflow_start;
+    i32 overflow_count;
+    i32 overflow_capacity;
+    u32 dropped;
+    char pad0[64];
+    u32 queue_tail;
+    u32 queue_committed;
+    char pad1[64];
+
     u32 output_replay_id;
     u32 last_output_keystate;
+
+    // Every key change of the loaded replay in tick order, and the next one
+    // to be played.
+    FSReplayEvent *replay_events;
+    i32 replay_event_count;
+    i32 replay_event_capacity;
+    i32 replay_event_cursor;
 };
 
 const char* daoGetDatabasePath(void);
 void daoInit(FSDao *dao);
+void daoDeinit(FSDao *dao);
 void daoSaveHiscore(FSDao *dao, const FSEngine *f);
 void daoInsertReplayOverview(FSDao *dao, const FSEngine *f);
-void daoInsertReplayInput(FSDao *dao, u32 ticks, u32 keystate);
+void daoInsertReplayInput(FSDao *dao, u32 ticks, i32 time, u32 keystate);
+void daoFlush(FSDao *dao);
 void daoMarkReplayComplete(FSDao *dao);
 
-void daoLoadReplay(FSDao *dao, FSEngine *f, u32 replay_id);
-u32 daoGetReplayInput(FSDao *dao, u32 tick);
+void daoLoadReplay(FSDao *dao, FSEngine *f, FSEngineConfig *c, u32 replay_id);
+void daoReadReplayOverview(sqlite3_stmt *s, int first, u32 *seed, FSEngineConfig *c);
+i32 daoGetReplayEvents(FSDao *dao, u32 tick, FSKeyEvent *dst, i32 capacity);
 
 #endif
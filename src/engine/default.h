@@ -34,6 +34,10 @@
 #define FSD_TICKS_PER_DRAW 1
 #endif
 
+#ifndef FSD_DRAW_RATE
+#define FSD_DRAW_RATE 0
+#endif
+
 #ifndef FSD_ARE_DELAY
 #define FSD_ARE_DELAY 0
 #endif
@@ -5,7 +5,6 @@
 // faststack Engine implementation.
 ///
 
-#include "dao.h"
 #include "default.h"
 #include "engine.h"
 #include "finesse.h"
@@ -24,34 +23,57 @@ const i8 pieceColors[FS_NPT] = {
 ///
 FSBlock fsFieldPieceBlock(FSBlock b)
 {
+    if (b == FS_GARBAGE_BLOCK) {
+        return FS_NPT;
+    }
+
     return (b > 0 ? b - 1 : 0) % FS_NPT;
 }
 
 ///
 // Return the next preview piece from the queue.
+//
+// The new piece is stored past the end of the ring before the head is
+// advanced, so this is correct even when the ring is full.
 ///
 static FSBlock nextPreviewPiece(FSEngine *f)
 {
     const FSBlock newPiece = fsNextRandomPiece(f);
 
-    if (f->nextPieceCount == 0) {
+    if (f->config->nextPieceCount == 0) {
         return newPiece;
     }
 
-    const FSBlock pendingPiece = f->nextPiece[0];
-    memmove(f->nextPiece, f->nextPiece + 1, f->nextPieceCount - 1);
-    f->nextPiece[f->nextPieceCount - 1] = newPiece;
+    const int mask = FS_MAX_PREVIEW_COUNT - 1;
+    const FSBlock pendingPiece = f->nextPiece[f->nextHead];
+    f->nextPiece[(f->nextHead + f->config->nextPieceCount) & mask] = newPiece;
+    f->nextHead = (f->nextHead + 1) & mask;
     return pendingPiece;
 }
 
+///
+// Return the mask of an empty row. Only the wall bits are set.
+///
+static FSRowMask emptyRowMask(const FSEngine *f)
+{
+    return ~((((FSRowMask) 1 << f->config->fieldWidth) - 1) << FS_ROW_PAD);
+}
+
 void fsGameReset(FSEngine *f)
 {
     // We cannot simply memset the entire structure since we want to preserve
-    // existing option (@O) values.
+    // the option (@O) values.
     //
-    // Typically any added @I or @E piece needs to be added here as well.
+    // Typically any added @I or @E piece needs to be added here as well, and
+    // to the snapshot values in `snapshot.c`.
     memset(f->b, 0, sizeof(f->b));
-    memset(f->randBuf, 0, sizeof(f->randBuf));
+    for (int y = 0; y < FS_MAX_HEIGHT; ++y) {
+        f->rowIndex[y] = y;
+        f->rowMask[y] = emptyRowMask(f);
+    }
+    memset(f->rowFill, 0, sizeof(f->rowFill));
+    memset(f->columnHeight, 0, sizeof(f->columnHeight));
+    memset(&f->randState, 0, sizeof(f->randState));
     memset(&f->lastInput, 0, sizeof(f->lastInput));
     f->se = 0;
     f->irsAmount = 0;
@@ -73,7 +95,7 @@ void fsGameReset(FSEngine *f)
     fsRandSeed(&f->randomContext, f->seed);
 
     // Signal that we are changing the randomizer and need to reinitialize
-    f->lastRandomizer = FST_RAND_UNDEFINED;
+    f->randState.randomizer = FST_RAND_UNDEFINED;
 
     f->state = FSS_READY;
     f->holdAvailable = true;
@@ -82,7 +104,8 @@ void fsGameReset(FSEngine *f)
     // We do not generate a new piece here since we do not want to render it
     // during the ready/go phase.
     f->piece = FS_NONE;
-    for (int i = 0; i < f->nextPieceCount; ++i) {
+    f->nextHead = 0;
+    for (int i = 0; i < f->config->nextPieceCount; ++i) {
         f->nextPiece[i] = fsNextRandomPiece(f);
     }
 }
@@ -92,33 +115,40 @@ void fsGameReset(FSEngine *f)
 //
 // We want this seperate from standard initialization so we can reset a game
 // without discarding user options.
-void fsGameInit(FSEngine *f)
-{
-    f->fieldWidth = FSD_FIELD_WIDTH;
-    f->fieldHeight = FSD_FIELD_HEIGHT;
-    f->fieldHidden = FSD_FIELD_HIDDEN;
-    f->msPerTick = FSD_MS_PER_TICK;
-    f->ticksPerDraw = FSD_TICKS_PER_DRAW;
-    f->areDelay = FSD_ARE_DELAY;
-    f->dasSpeed = FSD_DAS_SPEED;
-    f->dasDelay = FSD_DAS_DELAY;
-    f->initialActionStyle = FSD_INITIAL_ACTION_STYLE;
-    f->lockStyle = FSD_LOCK_STYLE;
-    f->lockDelay = FSD_LOCK_DELAY;
-    f->rotationSystem = FSD_ROTATION_SYSTEM;
-    f->gravity = FSD_GRAVITY;
-    f->softDropGravity = FSD_SOFT_DROP_GRAVITY;
-    f->randomizer = FSD_RANDOMIZER;
-    f->floorkickLimit = FSD_FLOORKICK_LIMIT;
-    f->infiniteReadyGoHold = FSD_INFINITE_READY_GO_HOLD;
-    f->nextPieceCount = FSD_NEXT_PIECE_COUNT;
-    f->warnOnBadFinesse = FSD_SOUND_ON_BAD_FINESSE;
-    f->areCancellable = FSD_ARE_CANCELLABLE;
-    f->readyPhaseLength = FSD_READY_PHASE_LENGTH;
-    f->goPhaseLength = FSD_GO_PHASE_LENGTH;
-    f->oneShotSoftDrop = FSD_ONE_SHOT_SOFT_DROP;
-    f->goal = FSD_GOAL;
+void fsConfigInit(FSEngineConfig *c)
+{
+    c->fieldWidth = FSD_FIELD_WIDTH;
+    c->fieldHeight = FSD_FIELD_HEIGHT;
+    c->fieldHidden = FSD_FIELD_HIDDEN;
+    c->msPerTick = FSD_MS_PER_TICK;
+    c->ticksPerDraw = FSD_TICKS_PER_DRAW;
+    c->drawRate = FSD_DRAW_RATE;
+    c->areDelay = FSD_ARE_DELAY;
+    c->dasSpeed = FSD_DAS_SPEED;
+    c->dasDelay = FSD_DAS_DELAY;
+    c->initialActionStyle = FSD_INITIAL_ACTION_STYLE;
+    c->lockStyle = FSD_LOCK_STYLE;
+    c->lockDelay = FSD_LOCK_DELAY;
+    c->rotationSystem = FSD_ROTATION_SYSTEM;
+    c->gravity = FSD_GRAVITY;
+    c->softDropGravity = FSD_SOFT_DROP_GRAVITY;
+    c->randomizer = FSD_RANDOMIZER;
+    c->floorkickLimit = FSD_FLOORKICK_LIMIT;
+    c->infiniteReadyGoHold = FSD_INFINITE_READY_GO_HOLD;
+    c->nextPieceCount = FSD_NEXT_PIECE_COUNT;
+    c->warnOnBadFinesse = FSD_SOUND_ON_BAD_FINESSE;
+    c->areCancellable = FSD_ARE_CANCELLABLE;
+    c->readyPhaseLength = FSD_READY_PHASE_LENGTH;
+    c->goPhaseLength = FSD_GO_PHASE_LENGTH;
+    c->oneShotSoftDrop = FSD_ONE_SHOT_SOFT_DROP;
+    c->goal = FSD_GOAL;
+}
+
+void fsGameInit(FSEngine *f, const FSEngineConfig *c)
+{
+    f->config = c;
 
+    fsInitPieceMasks();
     fsGameReset(f);
 }
 
@@ -127,7 +157,7 @@ void fsGameInit(FSEngine *f)
 ///
 void fsGetBlocks(const FSEngine *f, i8x2 *dst, i8 piece, int x, int y, int theta)
 {
-    const FSRotationSystem *rs = rotationSystems[f->rotationSystem];
+    const FSRotationSystem *rs = rotationSystems[f->config->rotationSystem];
     const int calcTheta = (theta + rs->entryTheta[piece]) & 3;
 
     for (int i = 0; i < FS_NBP; ++i) {
@@ -139,33 +169,56 @@ void fsGetBlocks(const FSEngine *f, i8x2 *dst, i8 piece, int x, int y, int theta
 ///
 // Return whether the specified position is occupied by a block/field.
 ///
-// If the coordinates are outside the field, false is returned.
+// If the coordinates are outside the field, true is returned.
 static bool isOccupied(const FSEngine *f, int x, int y)
 {
-    if (x < 0 || x >= f->fieldWidth || y < 0 || y >= f->fieldHeight) {
+    const int bit = x + FS_ROW_PAD;
+
+    if (y < 0 || y >= f->config->fieldHeight || bit < 0 || bit >= (int) (8 * sizeof(FSRowMask))) {
         return true;
     }
 
-    return f->b[y][x] >= 1;
+    return (f->rowMask[y] >> bit) & 1;
 }
 
 ///
-// Does the current piece collide at the specified coordinates/rotation.
+// Does the specified piece mask collide when placed at the specified
+// coordinates.
+//
+// The bounding box is checked against the field bounds first. This also
+// guarantees the shifted piece rows lie within the row mask.
 ///
-static bool isCollision(const FSEngine *f, int x, int y, int theta)
+bool fsIsMaskCollision(const FSEngine *f, const FSPieceMask *m, int x, int y)
 {
-    i8x2 blocks[FS_NBP];
-
-    fsGetBlocks(f, blocks, f->piece, x, y, theta);
+    if (x + m->minX < 0 || x + m->maxX >= f->config->fieldWidth ||
+        y + m->minY < 0 || y + m->maxY >= f->config->fieldHeight) {
+        return true;
+    }
 
-    for (int i = 0; i < FS_NBP; ++i) {
-        if (isOccupied(f, blocks[i].x, blocks[i].y)) {
+    for (int r = m->minY; r <= m->maxY; ++r) {
+        if (f->rowMask[y + r] & ((FSRowMask) m->rows[r] << (x + FS_ROW_PAD))) {
             return true;
         }
     }
     return false;
 }
 
+///
+// Return the mask of the current piece in the specified rotation state.
+///
+static const FSPieceMask* pieceMask(const FSEngine *f, int theta)
+{
+    return &pieceMasks[f->config->rotationSystem][f->piece][theta & 3];
+}
+
+///
+// Does the current piece collide at the specified coordinates/rotation.
+///
+static bool isCollision(const FSEngine *f, int x, int y, int theta)
+{
+    return fsIsMaskCollision(f, pieceMask(f, theta), x, y);
+}
+
 ///
 // Lock the current piece and perform post-piece specific routines.
 ///
@@ -176,7 +229,19 @@ static void lockPiece(FSEngine *f)
     f->blocksPlaced += 1;
 
     for (int i = 0; i < FS_NBP; ++i) {
-        f->b[blocks[i].y][blocks[i].x] = pieceColors[f->piece];
+        const int x = blocks[i].x;
+        const int y = blocks[i].y;
+
+        const FSRowMask bit = (FSRowMask) 1 << (x + FS_ROW_PAD);
+
+        // A piece can lock overlapping the stack after a hold at the top of
+        // the field, so only count newly filled cells.
+        f->b[f->rowIndex[y]][x] = pieceColors[f->piece];
+        f->rowFill[y] += !(f->rowMask[y] & bit);
+        f->rowMask[y] |= bit;
+        if (f->columnHeight[x] < f->config->fieldHeight - y) {
+            f->columnHeight[x] = f->config->fieldHeight - y;
+        }
     }
 
     // Rotation in x field, Movement in y field
@@ -200,7 +265,7 @@ static void newPiece(FSEngine *f)
     // Else we are maintaining the current where we map only when the blocks
     // themselves are generated. Think about this.
 
-    f->x = f->fieldWidth / 2 - 2;
+    f->x = f->config->fieldWidth / 2 - 2;
 
     // We cannot spawn at 0, else Z, S cannot rotate under sega rules.
     // NOTE: Adjust hidden value on render side potentially to account.
@@ -224,11 +289,12 @@ static void newPiece(FSEngine *f)
 // Notes:
 //  * These conditionals are a little hard to parse.
 ///
-static bool wkCondArikaLJT(const FSEngine *f, int direction)
+static bool wkCondArikaLJT(const FSEngine *f, FSBlock piece, int x, int y,
+                           int theta, int direction)
 {
     // The following states are invalid if the x slot is occupied AND
     // the o slot is not occupied and traveling the specified
-    switch (f->piece) {
+    switch (piece) {
       ///
       //  (cw)               (aw)
       //     o    x     x      o
@@ -236,16 +302,16 @@ static bool wkCondArikaLJT(const FSEngine *f, int direction)
       //    x@     @   @@@   @@@
       ///
       case FS_J:
-        if (f->theta == 0 && (isOccupied(f, f->x + 1, f->y) ||
-                (isOccupied(f, f->x + 1, f->y + 2) &&
+        if (theta == 0 && (isOccupied(f, x + 1, y) ||
+                (isOccupied(f, x + 1, y + 2) &&
                 (direction == FST_ROT_CLOCKWISE ||
-                 !isOccupied(f, f->x + 2, f->y))))) {
+                 !isOccupied(f, x + 2, y))))) {
             return true;
         }
-        if (f->theta == 2 && (isOccupied(f, f->x + 1, f->y) ||
-                (isOccupied(f, f->x + 1, f->y + 1) &&
+        if (theta == 2 && (isOccupied(f, x + 1, y) ||
+                (isOccupied(f, x + 1, y + 1) &&
                 (direction == FST_ROT_ANTICLOCKWISE ||
-                 !isOccupied(f, f->x + 2, f->y))))) {
+                 !isOccupied(f, x + 2, y))))) {
             return true;
         }
         break;
@@ -257,16 +323,16 @@ static bool wkCondArikaLJT(const FSEngine *f, int direction)
       //   @x    @     @@@   @@@
       ///
       case FS_L:
-        if (f->theta == 0 && (isOccupied(f, f->x + 1, f->y) ||
-                (isOccupied(f, f->x + 1, f->y + 2) &&
+        if (theta == 0 && (isOccupied(f, x + 1, y) ||
+                (isOccupied(f, x + 1, y + 2) &&
                 (direction == FST_ROT_ANTICLOCKWISE ||
-                 !isOccupied(f, f->x, f->y))))) {
+                 !isOccupied(f, x, y))))) {
             return true;
         }
-        if (f->theta == 2 && (isOccupied(f, f->x + 1, f->y - 1) ||
-                (isOccupied(f, f->x + 1, f->y) &&
+        if (theta == 2 && (isOccupied(f, x + 1, y - 1) ||
+                (isOccupied(f, x + 1, y) &&
                 (direction == FST_ROT_CLOCKWISE ||
-                 !isOccupied(f, f->x, f->y - 1))))) {
+                 !isOccupied(f, x, y - 1))))) {
             return true;
         }
         break;
@@ -277,10 +343,10 @@ static bool wkCondArikaLJT(const FSEngine *f, int direction)
       //   @@@    @
       ///
       case FS_T:
-        if (f->theta == 0 && isOccupied(f, f->x + 1, f->y)) {
+        if (theta == 0 && isOccupied(f, x + 1, y)) {
             return true;
         }
-        if (f->theta == 2 && isOccupied(f, f->x + 1, f->y - 1)) {
+        if (theta == 2 && isOccupied(f, x + 1, y - 1)) {
             return true;
         }
         break;
@@ -293,23 +359,28 @@ static bool wkCondArikaLJT(const FSEngine *f, int direction)
 }
 
 ///
-// Attempt to perform a rotation, returning whether the rotation succeeded.
+// Find the position of a piece after rotating it with the rotation system.
+//
+// This does not modify the engine. On success the rotated position and theta
+// are stored in `dst` and `floorkick` is set if the kick moved the piece
+// upwards.
 ///
-static bool doRotate(FSEngine *f, i8 direction)
+bool fsTryRotate(const FSEngine *f, FSBlock piece, int x, int y, int theta,
+                 int direction, i8x3 *dst, bool *floorkick)
 {
-    i8 newDir = (f->theta + 4 + direction) & 3;
-    const FSRotationSystem *rs = rotationSystems[f->rotationSystem];
+    i8 newDir = (theta + 4 + direction) & 3;
+    const FSRotationSystem *rs = rotationSystems[f->config->rotationSystem];
 
     i8 tableNo = 0;
     switch (direction) {
       case FST_ROT_CLOCKWISE:
-        tableNo = rs->kicksR[f->piece];
+        tableNo = rs->kicksR[piece];
         break;
       case FST_ROT_ANTICLOCKWISE:
-        tableNo = rs->kicksL[f->piece];
+        tableNo = rs->kicksL[piece];
         break;
       case FST_ROT_HALFTURN:
-        tableNo = rs->kicksH[f->piece];
+        tableNo = rs->kicksH[piece];
         break;
       default:
         abort();
@@ -319,45 +390,40 @@ static bool doRotate(FSEngine *f, i8 direction)
                                     ? &rs->kickTables[tableNo]
                                     : &emptyWallkickTable;
 
+    const FSPieceMask *m = &pieceMasks[f->config->rotationSystem][piece][newDir];
+
     // The `.z` field stores special wallkick flags.
     for (int k = 0; k < FS_MAX_KICK_LEN; ++k) {
         // NOTE: Check which theta we should be using here
         // We need to reverse the kick rotation here
-        const i8x3 kickData = (*table)[f->theta][k];
+        const i8x3 kickData = (*table)[theta][k];
 
         if (kickData.z == WK_END) {
             break;
         }
 
         // Handle special TGM123 rotation which is based on field state.
-        if (kickData.z == WK_ARIKA_LJT && wkCondArikaLJT(f, direction)) {
+        if (kickData.z == WK_ARIKA_LJT &&
+                wkCondArikaLJT(f, piece, x, y, theta, direction)) {
             break;
         }
 
-        int kickX = kickData.x + f->x;
-        int kickY = kickData.y + f->y;
+        int kickX = kickData.x + x;
+        int kickY = kickData.y + y;
 
-        if (!isCollision(f, kickX, kickY, newDir)) {
+        if (!fsIsMaskCollision(f, m, kickX, kickY)) {
             // To determine a floorkick, we cannot just check the kickData.y
             // value since this may be adjusted for a different rotation system
             // (i.e. sega).
             //
             // We need to compute the difference between the current kickData.y
             // and the initial kickData.y instead to get an accurate reading.
-            const int adjKickY = kickData.y - (*table)[f->theta][0].y;
+            const int adjKickY = kickData.y - (*table)[theta][0].y;
 
-            if (f->floorkickLimit && adjKickY < 0) {
-                if (f->floorkickCount++ >= f->floorkickLimit) {
-                    f->lockTimer = TICKS(f->lockDelay);
-                }
-            }
-
-            // Preserve the fractional y drop during rotation to disallow
-            // implicit lock reset.
-            f->actualY = fix(kickY) + unfixfrc(f->actualY);
-            f->y = kickY;
-            f->x = kickX;
-            f->theta = newDir;
+            dst->x = kickX;
+            dst->y = kickY;
+            dst->z = newDir;
+            *floorkick = adjKickY < 0;
             return true;
         }
     }
@@ -366,13 +432,38 @@ static bool doRotate(FSEngine *f, i8 direction)
 }
 
 ///
-// Apply the specified gravity to the piece.
-//
-// `gravity` is includes the calculated soft drop amount.
+// Attempt to perform a rotation, returning whether the rotation succeeded.
 ///
-static void doPieceGravity(FSEngine *f, i8 gravity)
+static bool doRotate(FSEngine *f, i8 direction)
 {
-    f->actualY += (f->msPerTick * f->gravity) + fix(gravity);
+    i8x3 pos;
+    bool floorkick;
+
+    if (!fsTryRotate(f, f->piece, f->x, f->y, f->theta, direction, &pos, &floorkick)) {
+        return false;
+    }
+
+    if (f->config->floorkickLimit && floorkick) {
+        if (f->floorkickCount++ >= f->config->floorkickLimit) {
+            f->lockTimer = TICKS(f->config->lockDelay);
+        }
+    }
+
+    // Preserve the fractional y drop during rotation to disallow
+    // implicit lock reset.
+    f->actualY = fix(pos.y) + unfixfrc(f->actualY);
+    f->y = pos.y;
+    f->x = pos.x;
+    f->theta = pos.z;
+    return true;
+}
+
+///
+// Move the piece down by `distance` (fixed point rows).
+///
+static void doPieceGravity(FSEngine *f, i32 distance)
+{
+    f->actualY += distance;
 
     // If we overshoot the bottom of the field, fix to the lowest possible y
     // value the piece is valid at instead.
@@ -385,7 +476,7 @@ static void doPieceGravity(FSEngine *f, i8 gravity)
         }
     }
     else {
-        if ((f->lockStyle == FST_LOCK_STEP || f->lockStyle == FST_LOCK_MOVE) &&
+        if ((f->config->lockStyle == FST_LOCK_STEP || f->config->lockStyle == FST_LOCK_MOVE) &&
                 unfixflr(f->actualY) > f->y) {
             f->lockTimer = 0;
         }
@@ -395,72 +486,232 @@ static void doPieceGravity(FSEngine *f, i8 gravity)
     }
 }
 
+///
+// Recalculate the height of every column from the row masks. Every row above
+// `top` must be empty.
+///
+static void updateColumnHeights(FSEngine *f, int top)
+{
+    FSRowMask seen = emptyRowMask(f);
+
+    memset(f->columnHeight, 0, sizeof(f->columnHeight));
+    for (int y = top; y < f->config->fieldHeight && seen != FS_ROW_FULL; ++y) {
+        const FSRowMask found = f->rowMask[y] & ~seen;
+        if (!found) {
+            continue;
+        }
+
+        for (int x = 0; x < f->config->fieldWidth; ++x) {
+            if (found & ((FSRowMask) 1 << (x + FS_ROW_PAD))) {
+                f->columnHeight[x] = f->config->fieldHeight - y;
+            }
+        }
+        seen |= found;
+    }
+}
+
+///
+// Return the highest field row which is not empty, or fieldHeight if the
+// field is empty.
+///
+static int stackTop(const FSEngine *f)
+{
+    int top = f->config->fieldHeight;
+
+    for (int x = 0; x < f->config->fieldWidth; ++x) {
+        if (f->config->fieldHeight - f->columnHeight[x] < top) {
+            top = f->config->fieldHeight - f->columnHeight[x];
+        }
+    }
+
+    return top;
+}
+
 ///
 // Find all full rows and clear them, moving upper rows down.
-// The algorithm used is as follows:
 //
-// 1. Check each row, setting a flag if it is full
-// 2. Walk through each row, if the flag was set copy it, else skip
-// 3. Clear remaining upper rows
+// Only rows covered by the piece that was just locked can be full, so only
+// the fill counts of these rows are checked. The algorithm used is as follows:
+//
+// 1. Find the full rows covered by the locked piece
+// 2. Walk upwards from the lowest covered row to the top of the stack,
+//    moving each row which is not full down to its new position
+// 3. Reuse the storage of the full rows for the vacated rows at the top of
+//    the stack
 //
-// This requires only two passes of the data, and at worst copying of
-// fieldHeight - 1 rows.
+// Moving a row only moves its storage index, mask and fill count. The only
+// field storage written is that of the cleared rows.
 ///
 static i8 clearLines(FSEngine *f)
 {
-    // This effectively limits the maximum possible height to 32 rows.
-    u32 foundLines = 0;
+    const FSPieceMask *m = pieceMask(f, f->theta);
+    const int top = f->y + m->minY;
+    const int bottom = f->y + m->maxY;
+    u8 cleared[FS_NBP];
     i8 filledLineCount = 0;
 
-    // 1: Mark filled rows.
-    for (int y = 0; y < f->fieldHeight; ++y) {
-        for (int x = 0; x < f->fieldWidth; ++x) {
-            if (f->b[y][x] == 0) {
-                goto next_row;
-            }
+    // 1: Find filled rows.
+    for (int y = top; y <= bottom; ++y) {
+        if (f->rowFill[y] == f->config->fieldWidth) {
+            cleared[filledLineCount++] = f->rowIndex[y];
         }
-        foundLines |= 1;
-        filledLineCount += 1;
-
-next_row:
-        foundLines <<= 1;
     }
 
-    // Fix the last extra shift that isn't required
-    foundLines >>= 1;
+    if (filledLineCount == 0) {
+        return 0;
+    }
 
-    // 2. Shift and replace filled rows.
-    int dst = f->fieldHeight - 1;
-    for (int src = dst; src >= 0; --src, foundLines >>= 1) {
-        if (foundLines & 1) {
+    // 2. Shift filled rows out. A row is always read before it could be
+    // overwritten since `dst >= src`.
+    const int stack = stackTop(f);
+    int dst = bottom;
+    for (int src = bottom; src >= stack; --src) {
+        if (src >= top && f->rowFill[src] == f->config->fieldWidth) {
             continue;
         }
 
         if (src != dst) {
-            memcpy(f->b[dst], f->b[src], sizeof(FSBlock) * f->fieldWidth);
+            f->rowIndex[dst] = f->rowIndex[src];
+            f->rowMask[dst] = f->rowMask[src];
+            f->rowFill[dst] = f->rowFill[src];
         }
 
         --dst;
     }
 
+    // 3. Place the cleared rows at the top of the stack.
     for (int i = 0; i < filledLineCount; ++i) {
-        memset(f->b[i], 0, sizeof(FSBlock) * f->fieldWidth);
+        const int y = stack + i;
+
+        f->rowIndex[y] = cleared[i];
+        memset(f->b[cleared[i]], 0, sizeof(FSBlock) * f->config->fieldWidth);
+        f->rowMask[y] = emptyRowMask(f);
+        f->rowFill[y] = 0;
     }
 
+    updateColumnHeights(f, stack + filledLineCount);
     return filledLineCount;
 }
 
+///
+// Return the lowest y a piece at the specified position can drop to.
+//
+// If every column of the piece is above the stack then the drop distance is
+// determined by the column heights alone. Otherwise the piece is beneath an
+// overhang or out of bounds and we walk down one row at a time. If the piece
+// collides at `y` then `y - 1` is returned.
+///
+int fsHardDropY(const FSEngine *f, const FSPieceMask *m, int x, int y)
+{
+    int distance = f->config->fieldHeight;
+
+    if (x + m->minX < 0 || x + m->maxX >= f->config->fieldWidth || y + m->minY < 0) {
+        distance = -1;
+    }
+
+    for (int c = m->minX; c <= m->maxX && distance >= 0; ++c) {
+        if (m->bottom[c] < 0) {
+            continue;
+        }
+
+        const int surface = f->config->fieldHeight - f->columnHeight[x + c];
+        const int gap = surface - (y + m->bottom[c]) - 1;
+        if (gap < 0) {
+            distance = -1;
+            break;
+        }
+        if (gap < distance) {
+            distance = gap;
+        }
+    }
+
+    if (distance >= 0) {
+        return y + distance;
+    }
+
+    while (!fsIsMaskCollision(f, m, x, y)) {
+        y += 1;
+    }
+    return y - 1;
+}
+
 ///
 // Recalculate and set the lowest valid Y position for the current piece.
 ///
 void updateHardDropY(FSEngine *f)
 {
-    int y = f->y;
-    while (!isCollision(f, f->x, y, f->theta)) {
-        y += 1;
+    f->hardDropY = fsHardDropY(f, pieceMask(f, f->theta), f->x, f->y);
+}
+
+void fsAddGarbage(FSEngine *f, int count, int hole)
+{
+    const int h = f->config->fieldHeight;
+    const int w = f->config->fieldWidth;
+    const FSRowMask holeBit = (FSRowMask) 1 << (hole + FS_ROW_PAD);
+    u8 reused[FS_MAX_HEIGHT];
+
+    assert(0 <= hole && hole < w);
+
+    if (count <= 0) {
+        return;
     }
+    if (count > h) {
+        count = h;
+    }
+
+    // Any block in the top rows is pushed out of the field.
+    const bool toppedOut = stackTop(f) < count;
+
+    // Raise the stack, reusing the storage of the top rows for the garbage.
+    memcpy(reused, f->rowIndex, count);
+    memmove(f->rowIndex, f->rowIndex + count, h - count);
+    memmove(f->rowMask, f->rowMask + count, (h - count) * sizeof(f->rowMask[0]));
+    memmove(f->rowFill, f->rowFill + count, h - count);
+
+    for (int i = 0; i < count; ++i) {
+        const int y = h - count + i;
+        FSBlock *row = f->b[reused[i]];
 
-    f->hardDropY = y - 1;
+        memset(row, FS_GARBAGE_BLOCK, w);
+        row[hole] = 0;
+
+        f->rowIndex[y] = reused[i];
+        f->rowMask[y] = FS_ROW_FULL & ~holeBit;
+        f->rowFill[y] = w - 1;
+    }
+
+    for (int x = 0; x < w; ++x) {
+        if (x != hole || f->columnHeight[x]) {
+            f->columnHeight[x] += count;
+        }
+        if (f->columnHeight[x] > h) {
+            f->columnHeight[x] = h;
+        }
+    }
+
+    if (toppedOut) {
+        f->state = FSS_GAMEOVER;
+        return;
+    }
+
+    // Raise an active piece out of the new stack. A piece in `FSS_LINES` is
+    // locked at its current position by the next tick so must be raised too.
+    if (f->state == FSS_FALLING || f->state == FSS_LANDED || f->state == FSS_LINES) {
+        const FSPieceMask *m = pieceMask(f, f->theta);
+
+        if (fsIsMaskCollision(f, m, f->x, f->y)) {
+            while (f->y + m->minY > 0 && fsIsMaskCollision(f, m, f->x, f->y)) {
+                f->y -= 1;
+            }
+            if (fsIsMaskCollision(f, m, f->x, f->y)) {
+                f->state = FSS_GAMEOVER;
+                return;
+            }
+            f->actualY = fix(f->y);
+        }
+
+        updateHardDropY(f);
+    }
 }
 
 ///
@@ -477,7 +728,7 @@ static bool tryHold(FSEngine *f)
         }
         else {
             // NOTE: Abstract into new piece of type theta
-            f->x = f->fieldWidth / 2 - 1;
+            f->x = f->config->fieldWidth / 2 - 1;
             f->y = 1;
             f->actualY = fix(f->y);
             f->theta = 0;
@@ -500,23 +751,77 @@ static bool tryHold(FSEngine *f)
 }
 
 ///
-// Perform a single game tick.
-//
-// This is just a state machine which is repeatedly called from the main
-// game loop. We do not want a 1 frame delay for some actions so we allow
-// some to run 'instantly'.
+// Return the distance the piece falls during a tick with the specified input.
 ///
-void fsGameTick(FSEngine *f, const FSInput *i)
+static i32 tickGravity(const FSEngine *f, const FSInput *i)
+{
+    return (f->config->msPerTick * f->config->gravity) + fix(i->gravity) + i->softDrop;
+}
+
+///
+// Apply the hold, rotation and movement of an input to the active piece,
+// followed by `distance` of gravity.
+///
+static void movePiece(FSEngine *f, const FSInput *i, i32 distance)
 {
-    i8 distance;
+    i8 movement;
     bool moved = false, rotated = false;
 
-    f->se = 0;
-    f->totalTicksRaw++;
+    if (i->extra & FST_INPUT_HOLD) {
+        tryHold(f);
+    }
 
-    // TODO: Remove lastInput since unused
-    f->lastInput = *i;
+    if (i->rotation) {
+        if (doRotate(f, i->rotation)) {
+            rotated = true;
+        }
+    }
+
+    // Left movement
+    movement = i->movement;
+    const FSPieceMask *m = pieceMask(f, f->theta);
+    for (; movement < 0; ++movement) {
+        if (!fsIsMaskCollision(f, m, f->x - 1, f->y)) {
+            f->x -= 1;
+            moved = true;
+        }
+    }
+
+    // Right movement
+    for (; movement > 0; --movement) {
+        if (!fsIsMaskCollision(f, m, f->x + 1, f->y)) {
+            f->x += 1;
+            moved = true;
+        }
+    }
 
+    if (moved || rotated) {
+        if (moved) {
+            f->se |= FST_SE_FLAG_MOVE;
+        }
+        if (rotated) {
+            f->se |= FST_SE_FLAG_ROTATE;
+        }
+
+        updateHardDropY(f);
+    }
+
+    doPieceGravity(f, distance);
+
+    // This must occur after we process the lockTimer to allow floorkick
+    // limits to be processed correctly. If we encounter a floorkick limit
+    // we set the lockTimer to max to allow a lock next frame, while still
+    // giving the user an option to perform a move/rotate input.
+    if ((moved || rotated) && f->config->lockStyle == FST_LOCK_MOVE) {
+        f->lockTimer = 0;
+    }
+}
+
+///
+// Apply the parts of an input which are handled in every state.
+///
+static void applyInputCounters(FSEngine *f, const FSInput *i)
+{
     // Always handle restart/quit events at any time.
     if (i->extra & FST_INPUT_RESTART) {
         f->state = FSS_RESTART;
@@ -535,6 +840,20 @@ void fsGameTick(FSEngine *f, const FSInput *i)
 
     // Always count the number of new keys pressed
     f->totalKeysPressed += i->newKeysCount;
+}
+
+///
+// Perform a single game tick without clearing the sound effects raised by
+// inputs applied earlier in the tick.
+///
+static void tick(FSEngine *f, const FSInput *i)
+{
+    f->totalTicksRaw++;
+
+    // TODO: Remove lastInput since unused
+    f->lastInput = *i;
+
+    applyInputCounters(f, i);
 
 beginTick:
     switch (f->state) {
@@ -549,7 +868,7 @@ beginTick:
             f->holdPiece = nextPreviewPiece(f);
             f->se |= FST_SE_FLAG_HOLD;
 
-            if (!f->infiniteReadyGoHold) {
+            if (!f->config->infiniteReadyGoHold) {
                 f->holdAvailable = false;
             }
         }
@@ -558,14 +877,14 @@ beginTick:
             f->se |= FST_SE_FLAG_READY;
         }
 
-        if (f->genericCounter == TICKS(f->readyPhaseLength)) {
+        if (f->genericCounter == TICKS(f->config->readyPhaseLength)) {
             f->se |= FST_SE_FLAG_GO;
             f->state = FSS_GO;
         }
 
         // This cannot be an `else if` since goPhaseLength could be 0.
-        if (f->genericCounter == TICKS(f->readyPhaseLength) +
-                                 TICKS(f->goPhaseLength)) {
+        if (f->genericCounter == TICKS(f->config->readyPhaseLength) +
+                                 TICKS(f->config->goPhaseLength)) {
             f->state = FSS_NEW_PIECE;
         }
 
@@ -589,7 +908,7 @@ beginTick:
         // frame with the piece already playable.
         // This may need some more tweaking since during fast play initial stack
         // far too easily.
-        if (f->initialActionStyle == FST_IA_PERSISTENT) {
+        if (f->config->initialActionStyle == FST_IA_PERSISTENT) {
             // Only check the current key state.
             // This is only dependent on the value on the final frame before the
             // piece spawns. Could adjust to allow any mid-ARE initial action to
@@ -619,10 +938,11 @@ beginTick:
             }
         }
 
-        if (f->areCancellable && (
+        if (f->config->areCancellable && (
                 i->rotation != 0 ||
                 i->movement != 0 ||
                 i->gravity  != 0 ||
+                i->softDrop != 0 ||
                 i->extra    != 0 ||
                 // We need to check ihs/irs since this is solely based on new
                 // key state and otherwise may not be picked up.
@@ -634,7 +954,7 @@ beginTick:
             goto beginTick;
         }
 
-        if (f->areTimer++ > TICKS(f->areDelay)) {
+        if (f->areTimer++ > TICKS(f->config->areDelay)) {
             f->areTimer = 0;
             f->state = FSS_NEW_PIECE;
             goto beginTick;
@@ -676,61 +996,15 @@ beginTick:
                 // We must recheck the lock timer state here since we may have
                 // moved back to FALLING from LANDED on the last frame and do
                 // **not** want to lock in mid-air!
-                (f->lockTimer >= TICKS(f->lockDelay) && f->state == FSS_LANDED)) {
+                (f->lockTimer >= TICKS(f->config->lockDelay) && f->state == FSS_LANDED)) {
             f->state = FSS_LINES;
 
             // Still need to apply piece gravity before entering FSS_LINES.
-            doPieceGravity(f, i->gravity);
+            doPieceGravity(f, tickGravity(f, i));
             break;
         }
 
-        if (i->extra & FST_INPUT_HOLD) {
-            tryHold(f);
-        }
-
-        if (i->rotation) {
-            if (doRotate(f, i->rotation)) {
-                rotated = true;
-            }
-        }
-
-        // Left movement
-        distance = i->movement;
-        for (; distance < 0; ++distance) {
-            if (!isCollision(f, f->x - 1, f->y, f->theta)) {
-                f->x -= 1;
-                moved = true;
-            }
-        }
-
-        // Right movement
-        for (; distance > 0; --distance) {
-            if (!isCollision(f, f->x + 1, f->y, f->theta)) {
-                f->x += 1;
-                moved = true;
-            }
-        }
-
-        if (moved || rotated) {
-            if (moved) {
-                f->se |= FST_SE_FLAG_MOVE;
-            }
-            if (rotated) {
-                f->se |= FST_SE_FLAG_ROTATE;
-            }
-
-            updateHardDropY(f);
-        }
-
-        doPieceGravity(f, i->gravity);
-
-        // This must occur after we process the lockTimer to allow floorkick
-        // limits to be processed correctly. If we encounter a floorkick limit
-        // we set the lockTimer to max to allow a lock next frame, while still
-        // giving the user an option to perform a move/rotate input.
-        if ((moved || rotated) && f->lockStyle == FST_LOCK_MOVE) {
-            f->lockTimer = 0;
-        }
+        movePiece(f, i, tickGravity(f, i));
 
         if (f->state == FSS_LANDED) {
             f->lockTimer++;
@@ -741,18 +1015,21 @@ beginTick:
       case FSS_LINES:
         lockPiece(f);
 
+        // This must be done while the locked piece is still set, since only
+        // the rows it covers are checked.
+        const int lines = clearLines(f);
+
         // NOTE: Make this conversion less *magic*
         f->se |= (1 << (FST_SE_IPIECE + f->piece));
         f->piece = FS_NONE;
 
-        const int lines = clearLines(f);
         if (0 < lines && lines <= 4) {
             // NOTE: Make this conversion less *magic*
             f->se |= (FST_SE_FLAG_ERASE1 << (lines - 1));
         }
 
         f->linesCleared += lines;
-        f->state = f->linesCleared < f->goal ? FSS_ARE : FSS_GAMEOVER;
+        f->state = f->linesCleared < f->config->goal ? FSS_ARE : FSS_GAMEOVER;
         goto beginTick;
 
       case FSS_GAMEOVER:
@@ -770,3 +1047,146 @@ beginTick:
 
     f->totalTicks += 1;
 }
+
+///
+// Perform a single game tick.
+//
+// This is just a state machine which is repeatedly called from the main
+// game loop. We do not want a 1 frame delay for some actions so we allow
+// some to run 'instantly'.
+///
+void fsGameTick(FSEngine *f, const FSInput *i)
+{
+    f->se = 0;
+    tick(f, i);
+}
+
+///
+// Apply an input to the active piece part way through a tick.
+//
+// Only actions are applied. Gravity and the lock, ARE and phase timers advance
+// with the tick itself, so the state machine keeps its tick-based timing.
+///
+static void tickPartial(FSEngine *f, const FSInput *i)
+{
+    applyInputCounters(f, i);
+
+    if (f->state != FSS_FALLING && f->state != FSS_LANDED) {
+        return;
+    }
+
+    if (i->extra & FST_INPUT_HARD_DROP) {
+        f->state = FSS_LINES;
+        doPieceGravity(f, fix(i->gravity) + i->softDrop);
+        return;
+    }
+
+    movePiece(f, i, fix(i->gravity) + i->softDrop);
+}
+
+///
+// Perform a single game tick from the key changes made during it.
+///
+void fsGameTickEvents(FSEngine *f, FSControl *c, const FSKeyEvent *events,
+                      i32 count, i32 start)
+{
+    const i32 length = f->config->msPerTick * 1000;
+    u32 keys = c->lastKeys;
+    u32 tapped = 0;
+    i32 last = 0, softDropTime = 0;
+
+    f->se = 0;
+
+    for (i32 k = 0; k < count; ++k) {
+        i32 time = fsTimeDiff(events[k].time, start);
+        if (time < last) {
+            time = last;
+        }
+        if (time > length) {
+            time = length;
+        }
+
+        if (keys & FST_VK_FLAG_DOWN) {
+            softDropTime += time - last;
+        }
+        const u32 pressed = events[k].keys & ~keys;
+        keys = events[k].keys;
+        last = time;
+
+        // Changes at the start of the tick are handled by the tick itself, as
+        // are changes while there is no piece to move. These are applied
+        // when the tick completes as if they occurred at its start, with any
+        // key pressed and released in the meantime still counted as pressed.
+        if (time == 0 || (f->state != FSS_FALLING && f->state != FSS_LANDED)) {
+            tapped |= pressed;
+        }
+        else {
+            // Auto shift up to the change is applied before it.
+            if (c->dasDirection != 0) {
+                FSInput shift = {0, 0, 0, 0, 0, 0, 0};
+                fsVirtualKeysToPartialInput(&shift, c->lastKeys, time, f, c);
+                if (shift.movement) {
+                    tickPartial(f, &shift);
+                }
+            }
+
+            FSInput in = {0, 0, 0, 0, 0, 0, 0};
+            fsVirtualKeysToPartialInput(&in, keys, time, f, c);
+            tickPartial(f, &in);
+        }
+    }
+
+    if (keys & FST_VK_FLAG_DOWN) {
+        softDropTime += length - last;
+    }
+
+    // Taps released before the tick completes only apply to this tick. The
+    // key state carried to the next tick is the one actually held.
+    FSInput in = {0, 0, 0, 0, 0, 0, 0};
+    fsVirtualKeysToInput(&in, keys | tapped, f, c);
+    c->lastKeys = keys;
+
+    // Held soft drop only moves the piece for the time it was held.
+    if (!f->config->oneShotSoftDrop && !(in.extra & FST_INPUT_HARD_DROP)) {
+        in.softDrop = (int64_t) softDropTime * f->config->softDropGravity / 1000;
+    }
+
+    tick(f, &in);
+}
+
+///
+// Has the game reached a state where no further ticks should be run.
+///
+static bool isGameFinished(const FSEngine *f)
+{
+    return f->state == FSS_GAMEOVER ||
+           f->state == FSS_RESTART ||
+           f->state == FSS_QUIT;
+}
+
+///
+// Run a sequence of key states through the engine as fast as possible.
+///
+i32 fsGameRunInputs(FSEngine *f, FSControl *c, const u32 *keys, i32 count,
+                    FSGameStats *stats)
+{
+    i32 n = 0;
+
+    while (n < count && !isGameFinished(f)) {
+        FSInput in = {0, 0, 0, 0, 0, 0, 0};
+        fsVirtualKeysToInput(&in, keys[n++], f, c);
+        fsGameTick(f, &in);
+    }
+
+    if (stats) {
+        stats->totalTicks = f->totalTicks;
+        stats->totalTicksRaw = f->totalTicksRaw;
+        stats->linesCleared = f->linesCleared;
+        stats->blocksPlaced = f->blocksPlaced;
+        stats->finesse = f->finesse;
+        stats->totalKeysPressed = f->totalKeysPressed;
+        stats->state = f->state;
+    }
+
+    return n;
+}
@@ -95,6 +95,40 @@ enum InitialActionType {
     FST_IA_TRIGGER
 };
 
+// Field value of a garbage block. This is distinct from any piece color.
+#define FS_GARBAGE_BLOCK (FS_NPT + 1)
+
+// Number of wall bits to the left of the first column in a row mask.
+//
+// A piece extends at most 3 cells from its origin so this is sufficient to
+// represent any piece with an origin left of the field.
+#define FS_ROW_PAD 3
+
+#if FS_MAX_HEIGHT > 126
+#error "FS_MAX_HEIGHT is too large to be represented by a row position"
+#endif
+
+#if FS_MAX_PREVIEW_COUNT & (FS_MAX_PREVIEW_COUNT - 1)
+#error "FS_MAX_PREVIEW_COUNT must be a power of two"
+#endif
+
+///
+// Occupancy mask of a single field row.
+//
+// A 32-bit mask is used unless a row and its wall cells do not fit, since
+// this keeps engines small for the common field sizes.
+///
+#if FS_MAX_WIDTH + 2 * FS_ROW_PAD > 64
+#error "FS_MAX_WIDTH is too large to be represented by a row mask"
+#elif FS_MAX_WIDTH + 2 * FS_ROW_PAD > 32
+typedef uint64_t FSRowMask;
+#else
+typedef u32 FSRowMask;
+#endif
+
+// A row mask with every cell (and wall) occupied.
+#define FS_ROW_FULL ((FSRowMask) ~(FSRowMask) 0)
+
 ///
 // All possible game states.
 ///
@@ -134,87 +168,143 @@ enum GameState {
 };
 
 ///
-// A single faststack game instance.
-//
-// Stores all internal variables and options pertaining to a field.
-// Values can be broken down into one of three classes.
-//
-//  * Internal Status (@I)
-//      Only used internally and never required to be read by a platform.
-//
-//  * External Status (@E)
-//      Calculated internally by the engine, but expected to be read by a
-//      user.
+// Options of a faststack game.
 //
-//  * Fixed Option (@O)
-//      Can be set by the user. Typically unsafe to change during execution.
-//
-//  We document which of the following variables belongs to which class. These
-//  are only guidelines and there may be cases where we need to break the
-//  following visibility rules.
-//
-//  Note: ANy 'Constraints' should always be true at any point in time.
+// These are set by the user before a game starts and are never modified by
+// the engine, so a single configuration can be shared by any number of
+// engines. Fields are grouped by size to avoid padding.
 ///
-struct FSEngine {
-    /// @E: Current field state.
-    FSBlock b[FS_MAX_HEIGHT][FS_MAX_WIDTH];
+struct FSEngineConfig {
+    /// Number of ms a key must be held before repeated movement.
+    //
+    // This is independent of `msPerTick`. DAS is charged in microseconds so
+    // the delay does not need to be a multiple of the tick length.
+    i32 dasDelay;
+
+    /// Microseconds between each repeated movement, or 0 to move instantly.
+    //
+    // Values shorter than a tick move the piece multiple cells per tick. This
+    // is set by the `arrUs` option.
+    i32 dasSpeed;
+
+    /// How many game ticks occur per draw update.
+    i32 ticksPerDraw;
+
+    /// Draw updates per second, or 0 to draw every `ticksPerDraw` ticks.
+    //
+    // This decouples drawing from the tick rate, e.g. running logic at 1000
+    // ticks per second with `msPerTick = 1` while drawing at 60 per second.
+    i32 drawRate;
+
+    /// Length in ms that ARE should take.
+    i32 areDelay;
+
+    /// Length in ms that it should take to lock a piece.
+    i32 lockDelay;
+
+    /// How many blocks a piece will fall by every ms.
+    int32_t gravity;
 
-    /// @O: Current field width.
+    /// How many blocks a piece will fall by every ms when soft dropping.
+    int32_t softDropGravity;
+
+    /// How long the "Ready" phase countdown should last in ms
+    i32 readyPhaseLength;
+
+    /// How long the "Go" phase countdown should last in ms
+    i32 goPhaseLength;
+
+    /// Target number of lines to clear during this game.
+    i32 goal;
+
+    /// Number of preview pieces generated ahead of the current piece.
+    //
+    //  * Constraints
+    //      * nextPieceCount <= FS_MAX_PREVIEW_COUNT
+    i16 nextPieceCount;
+
+    /// Current field width.
     //
     //  * Constraints
     //      * fieldWidth < FS_MAX_WIDTH
     i8 fieldWidth;
 
-    /// @O: Current field height.
+    /// Current field height.
     //
     //  * Constraints
     //      * fieldHeight < FS_MAX_HEIGHT
     i8 fieldHeight;
 
-    /// @0: Number of hidden rows.
+    /// Number of hidden rows.
     //
     // These are not extra rows, but rather count how many field rows are
     // treated as hidden.
     i8 fieldHidden;
 
-    /// @E: Next available pieces.
-    FSBlock nextPiece[FS_MAX_PREVIEW_COUNT];
-
-    /// @I: Current random state context.
-    FSRandCtx randomContext;
-
-    /// @I: Buffer for calculating next pieces.
-    FSBlock randBuf[FS_RAND_BUFFER_LEN];
+    /// The way we should handle Initial Actions.
+    i8 initialActionStyle;
 
-    /// @I: An extra buffer for caching special values across rolls.
-    u32 randBufExtra[FS_RAND_BUFFER_EXTRA_LEN];
+    /// Milliseconds between each game logic update.
+    i8 msPerTick;
 
-    /// @I: Index for `randBuf`
-    int randBufIndex;
+    /// Current lock reset style in use.
+    i8 lockStyle;
 
-    /// @O: The way we should handle Initial Actions.
-    i8 initialActionStyle;
+    /// Maximum number of floorkicks allowed per piece.
+    i8 floorkickLimit;
 
-    /// @E: Current sound effects to be played this frame.
-    u32 se;
+    /// Current rotation system being used.
+    i8 rotationSystem;
 
-    /// @E: Current pieces type.
-    FSBlock piece;
+    /// Current randomizer in play.
+    i8 randomizer;
 
-    /// @I: How many rotations have been done for the current piece.
-    i32 pieceRotateCount;
+    /// Should a sound be played if bad finesse is performed
+    bool warnOnBadFinesse;
 
-    /// @I: How many movement presses have been done for the current piece.
-    i32 pieceMovePressCount;
+    /// Can ARE be cancelled by input
+    bool areCancellable;
 
-    /// @E: Overall finesse counter for the game
-    i32 finesse;
+    /// Should soft drop be a single shot on each key press.
+    bool oneShotSoftDrop;
 
-    /// @E: Current pieces x position.
-    i8 x;
+    /// Whether infinite hold is allowed during pre-game.
+    bool infiniteReadyGoHold;
+};
 
-    /// @E: Current pieces y position.
-    i8 y;
+///
+// A single faststack game instance.
+//
+// Stores all internal variables pertaining to a field, and a pointer to the
+// options in use. Values can be broken down into one of three classes.
+//
+//  * Internal Status (@I)
+//      Only used internally and never required to be read by a platform.
+//
+//  * External Status (@E)
+//      Calculated internally by the engine, but expected to be read by a
+//      user.
+//
+//  * Fixed Option (@O)
+//      Can be set by the user. Typically unsafe to change during execution.
+//      These are stored in the shared `FSEngineConfig`.
+//
+//  We document which of the following variables belongs to which class. These
+//  are only guidelines and there may be cases where we need to break the
+//  following visibility rules.
+//
+//  Values are laid out in three blocks. The hot state read and written by
+//  every tick comes first and must fit in `FS_ENGINE_HOT_SIZE` bytes. This is
+//  followed by the field, and finally the cold state only touched when a
+//  piece is spawned or locked, or by a platform.
+//
+//  Note: ANy 'Constraints' should always be true at any point in time.
+///
+struct FSEngine {
+    /// @O: Options in use.
+    //
+    // This can be shared between engines and must outlive them.
+    const FSEngineConfig *config;
 
     /// @I: Actual y position with greater precision.
     //
@@ -225,54 +315,12 @@ struct FSEngine {
     //      * actualY == tofix(y)
     int32_t actualY;
 
-    /// @I: Greatest 'y' the current piece can exist at without a collision.
-    i8 hardDropY;
-
-    /// @E: Current pieces rotation state.
-    i8 theta;
-
-    /// @I: Current Initial Rotation status (set in ARE)
-    i8 irsAmount;
-
-    /// @I: Current Initial Hold status (set in ARE)
-    bool ihsFlag;
-
-    /// @O: How many blocks a piece moves per ms.
-    i8 dasSpeed;
-
-    /// @O: Number of ms a key must be held before repeated movement.
-    i32 dasDelay;
-
-    /// @E: Total number of new keys pressed during game.
-    i32 totalKeysPressed;
-
-    /// @O: Milliseconds between each game logic update.
-    i8 msPerTick;
-
-    /// @O: How many game ticks occur per draw update.
-    i32 ticksPerDraw;
-
-    /// @O: Length in ms that ARE should take.
-    i32 areDelay;
+    /// @I: Counter for locking.
+    i32 lockTimer;
 
     /// @I: Counter for ARE.
     i32 areTimer;
 
-    /// @O: Should a sound be played if bad finesse is performed
-    bool warnOnBadFinesse;
-
-    /// @O: Can ARE be cancelled by input
-    bool areCancellable;
-
-    /// @E: Actual game length using a high precision timer.
-    //
-    // The game length is usually calculated as 'msPerTick * totalTicks' but
-    // this is potentially inaccurate up to (+-msPerTick). 'actualTimer' acts
-    // as a reliable source to ensure the game was played at the correct speed.
-    //
-    // This is calculated **only** on game finish.
-    i32 actualTime;
-
     /// @I: Generic counter for multi-tick usage.
     i32 genericCounter;
 
@@ -282,32 +330,32 @@ struct FSEngine {
     /// @E: Actual number of elapsed ticks (including ready, go).
     i32 totalTicksRaw;
 
-    /// @O: Current lock reset style in use.
-    i8 lockStyle;
+    /// @E: Total number of new keys pressed during game.
+    i32 totalKeysPressed;
 
-    /// @O: Length in ms that it should take to lock a piece.
-    i32 lockDelay;
+    /// @I: How many rotations have been done for the current piece.
+    i32 pieceRotateCount;
 
-    /// @I: Counter for locking.
-    i32 lockTimer;
+    /// @I: How many movement presses have been done for the current piece.
+    i32 pieceMovePressCount;
 
-    /// @O: Maximum number of floorkicks allowed per piece.
-    i8 floorkickLimit;
+    /// @E: Current sound effects to be played this frame.
+    u32 se;
 
-    /// @I: Count for how many floorkicks have occured.
-    i8 floorkickCount;
+    /// @E: Current pieces x position.
+    i8 x;
 
-    /// @O: Should soft drop be a single shot on each key press.
-    bool oneShotSoftDrop;
+    /// @E: Current pieces y position.
+    i8 y;
 
-    /// @O: Current rotation system being used.
-    i8 rotationSystem;
+    /// @E: Current pieces rotation state.
+    i8 theta;
 
-    /// @O: How many blocks a piece will fall by every ms.
-    int32_t gravity;
+    /// @I: Greatest 'y' the current piece can exist at without a collision.
+    i8 hardDropY;
 
-    /// @O: How many blocks a piece will fall by every ms when soft dropping.
-    int32_t softDropGravity;
+    /// @E: Current pieces type.
+    FSBlock piece;
 
     /// @E: Current state of the internal engine.
     i8 state;
@@ -315,57 +363,186 @@ struct FSEngine {
     /// @E: State of the game during the last frame.
     i8 lastState;
 
-    /// @I: Key input applied during the last logic update.
-    FSInput lastInput;
+    /// @I: Current Initial Rotation status (set in ARE)
+    i8 irsAmount;
 
-    /// @O: Current randomizer in play. */
-    i8 randomizer;
+    /// @I: Count for how many floorkicks have occured.
+    i8 floorkickCount;
 
-    /// @I: Randomizer seed
-    u32 seed;
+    /// @I: Current Initial Hold status (set in ARE)
+    bool ihsFlag;
+
+    /// @I: Whether a hold can be performed.
+    bool holdAvailable;
 
-    /// @I: The randomizer in use during the last game update.
+    /// @I: Occupancy bitmask of each field row.
+    //
+    // Bit `x + FS_ROW_PAD` is set if field cell (x, y) is occupied. All bits
+    // outside of the field width are always set so the walls act as occupied
+    // cells.
+    //
+    // This is the first value after the hot state.
     //
-    // Used to determine if reinitialization of a randomizer is required.
-    // This allows one to alter than randomizer mid-game.
-    i8 lastRandomizer;
+    //  * Constraints
+    //      * rowMask[y] mirrors the occupancy of b[rowIndex[y]]
+    FSRowMask rowMask[FS_MAX_HEIGHT];
 
-    /// @O: How long the "Ready" phase countdown should last in ms
-    i32 readyPhaseLength;
+    /// @I: Number of occupied cells in each field row.
+    //
+    //  * Constraints
+    //      * rowFill[y] is the number of occupied cells in b[rowIndex[y]]
+    i8 rowFill[FS_MAX_HEIGHT];
 
-    /// @O: How long the "Go" phase countdown should last in ms
-    i32 goPhaseLength;
+    /// @I: Height of the highest occupied cell in each column.
+    //
+    // A column whose highest block is at row `y` has height `fieldHeight - y`
+    // and an empty column has height 0. The number of holes in the field is
+    // the sum of all column heights less the sum of all row fills.
+    //
+    //  * Constraints
+    //      * columnHeight[x] is consistent with the field
+    i8 columnHeight[FS_MAX_WIDTH];
 
-    /// @O: Whether infinite hold is allowed during pre-game.
-    bool infiniteReadyGoHold;
+    /// @I: Storage row of `b` used by each field row.
+    //
+    //  * Constraints
+    //      * rowIndex is a permutation of 0..FS_MAX_HEIGHT - 1
+    u8 rowIndex[FS_MAX_HEIGHT];
 
-    /// @O: Number of preview pieces displayed.
-    i8 nextPieceCount;
+    /// @E: Storage for the field rows.
+    //
+    // Rows are not stored in field order. Field row `y` is stored in
+    // `b[rowIndex[y]]` so clearing or inserting rows only moves indices.
+    // Use `fsGetFieldBlock` to read the field.
+    FSBlock b[FS_MAX_HEIGHT][FS_MAX_WIDTH];
 
-    /// @I: Whether a hold can be performed.
-    bool holdAvailable;
+    /// @E: Next available pieces.
+    //
+    // This is a ring of `nextPieceCount` pieces starting at `nextHead`. Use
+    // `fsGetNextPiece` to read the preview in order.
+    FSBlock nextPiece[FS_MAX_PREVIEW_COUNT];
+
+    /// @I: Index of the first preview piece in `nextPiece`.
+    i16 nextHead;
 
     /// @E: Current piece we are holding.
     FSBlock holdPiece;
 
+    /// @I: Is this a replay and not a real game?
+    bool replay;
+
+    /// @I: Current random state context.
+    FSRandCtx randomContext;
+
+    /// @I: Current randomizer state.
+    //
+    // The randomizer it was initialized for determines if reinitialization
+    // is required. This allows one to alter the randomizer mid-game.
+    FSRandState randState;
+
+    /// @I: Randomizer seed
+    u32 seed;
+
+    /// @E: Overall finesse counter for the game
+    i32 finesse;
+
     /// @E: Number of cleared lines during the games lifetime
     i32 linesCleared;
 
     /// @E: Number of blocks placed during the games lifetime.
     i32 blocksPlaced;
 
-    /// @O: Target number of lines to clear during this game.
-    i32 goal;
+    /// @E: Actual game length using a high precision timer.
+    //
+    // The game length is usually calculated as 'msPerTick * totalTicks' but
+    // this is potentially inaccurate up to (+-msPerTick). 'actualTimer' acts
+    // as a reliable source to ensure the game was played at the correct speed.
+    //
+    // This is calculated **only** on game finish.
+    i32 actualTime;
 
-    /// @I: Is this a replay and not a real game?
-    bool replay;
+    /// @I: Key input applied during the last logic update.
+    FSInput lastInput;
+};
+
+// Maximum size of the hot state at the start of an `FSEngine`.
+#define FS_ENGINE_HOT_SIZE 64
+
+// Compile-time check that the hot state fits. An array with a negative size
+// is an error.
+typedef char FSEngineHotSizeCheck[
+    offsetof(FSEngine, rowMask) <= FS_ENGINE_HOT_SIZE ? 1 : -1];
+
+///
+// Summary of a game as computed by `fsGameRunInputs`.
+///
+struct FSGameStats {
+    /// Number of ticks that elapsed during the game (excluding ready, go).
+    i32 totalTicks;
+
+    /// Number of ticks that elapsed including ready, go.
+    i32 totalTicksRaw;
+
+    /// Number of lines cleared.
+    i32 linesCleared;
+
+    /// Number of blocks placed.
+    i32 blocksPlaced;
+
+    /// Number of finesse faults.
+    i32 finesse;
+
+    /// Total number of new keys pressed.
+    i32 totalKeysPressed;
+
+    /// State of the engine after the final tick.
+    i8 state;
 };
 
 ///
 // Transform a field block into an actual block representation.
+//
+// A garbage block is given `FS_NPT`, the slot after the last piece, so a
+// frontend can draw it in a colour of its own.
 ///
 FSBlock fsFieldPieceBlock(FSBlock b);
 
+///
+// Return the block at the specified field position, 0 if empty.
+///
+static inline FSBlock fsGetFieldBlock(const FSEngine *f, int x, int y)
+{
+    return f->b[f->rowIndex[y]][x];
+}
+
+///
+// Return the specified preview piece, where 0 is the next piece to spawn.
+///
+static inline FSBlock fsGetNextPiece(const FSEngine *f, int i)
+{
+    return f->nextPiece[(f->nextHead + i) & (FS_MAX_PREVIEW_COUNT - 1)];
+}
+
+///
+// Push garbage rows onto the bottom of the field.
+//
+// The existing stack is raised by `count` rows. Each garbage row is filled
+// except for column `hole`. If the stack is pushed above the field the game
+// is over. An active piece is raised too if it would otherwise overlap the
+// new stack, including a piece which has been dropped but is not yet locked.
+//
+//  * FSEngine *f
+//      The instance to add garbage to.
+//
+//  * int count
+//      Number of garbage rows to add. Values above the field height are
+//      clamped.
+//
+//  * int hole
+//      Column which is left empty in every garbage row.
+///
+void fsAddGarbage(FSEngine *f, int count, int hole);
+
 ///
 // Clear the specified game instance.
 //
@@ -378,13 +555,24 @@ FSBlock fsFieldPieceBlock(FSBlock b);
 ///
 void fsGameReset(FSEngine *f);
 
+///
+// Set every option of a configuration to its default value.
+///
+void fsConfigInit(FSEngineConfig *c);
+
 ///
 // Initialize a game instance.
 //
-// This will reset all internal variables and also set options to their
-// default values.
+// This will reset all internal variables and use the specified options.
+//
+//  * FSEngine *f
+//      The instance to initialize.
+//
+//  * const FSEngineConfig *c
+//      The options to use. This is not copied so must outlive the instance.
+//      It can be modified between games, but never during one.
 ///
-void fsGameInit(FSEngine *f);
+void fsGameInit(FSEngine *f, const FSEngineConfig *c);
 
 ///
 // Perform a single game update.
@@ -397,6 +585,69 @@ void fsGameInit(FSEngine *f);
 ///
 void fsGameTick(FSEngine *f, const FSInput *i);
 
+///
+// Perform a single game update from the key changes made during it.
+//
+// Each change is applied at the time it occurred instead of being collapsed
+// into a single input. New presses rotate, move, hold and hard drop the piece
+// at that point in the tick, and held soft drop only moves the piece for the
+// part of the tick it was held. Gravity and all timers still advance once per
+// tick, so the result depends only on the events and is reproducible.
+//
+// Changes at the start of the tick, or while no piece is in play, behave the
+// same as `fsVirtualKeysToInput` followed by `fsGameTick`. A key pressed and
+// released among these changes is treated as held for that tick, so taps made
+// during ARE or a line clear still perform an initial rotation or hold.
+//
+//  * FSEngine *f
+//      The instance to update
+//
+//  * FSControl *c
+//      Key state carried between ticks.
+//
+//  * const FSKeyEvent *events
+//      Key changes in the order they occurred. Times before the start or
+//      after the end of the tick are clamped to it.
+//
+//  * i32 count
+//      Number of entries in `events`.
+//
+//  * i32 start
+//      Time the tick began in microseconds, on the same clock as the events.
+///
+void fsGameTickEvents(FSEngine *f, FSControl *c, const FSKeyEvent *events,
+                      i32 count, i32 start);
+
+///
+// Run a sequence of ticks without any frontend involvement.
+//
+// Each key state is converted with `fsVirtualKeysToInput` and applied with
+// `fsGameTick` back-to-back. No sleeping, logging or replay recording occurs,
+// so this is suitable for verifying replays and benchmarking the engine.
+//
+// The run stops early if the game finishes (game over, quit or restart).
+//
+//  * FSEngine *f
+//      The instance to update. This should already be reset.
+//
+//  * FSControl *c
+//      The control state used during key conversion. This must be zeroed
+//      before the first tick of a game.
+//
+//  * const u32 *keys
+//      Virtual key state for each tick (see `FST_VK_FLAG_*`).
+//
+//  * i32 count
+//      Number of entries in `keys`.
+//
+//  * FSGameStats *stats
+//      Stores the game statistics after the final tick. Can be NULL.
+//
+// Returns the number of ticks that were performed.
+///
+i32 fsGameRunInputs(FSEngine *f, FSControl *c, const u32 *keys, i32 count,
+                    FSGameStats *stats);
+
 ///
 // Convert the specified into its individual blocks.
 //
@@ -18,8 +18,12 @@
 #include "default.h"
 #include "engine.h"
 #include "internal.h"
+#include "latency.h"
+#include "movegen.h"
 #include "rand.h"
+#include "replay.h"
 #include "rotation.h"
+#include "snapshot.h"
 #include "view.h"
 
 #ifndef FS_DISABLE_OPTION
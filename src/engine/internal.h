@@ -8,6 +8,9 @@
 #ifndef FS_INTERNAL_H
 #define FS_INTERNAL_H
 
+#include "core.h"
+#include "rotation.h"
+
 // Sentinel value for terminating a wallkick test array.
 #define WK_END 0x71
 
@@ -16,11 +19,18 @@
 
 // Convert ms into the corresponding ticks value. This assumes that an
 // `FSEngine` is within scope and bound to the variable `f`.
-#define TICKS(x) ((x) / (f->msPerTick))
+#define TICKS(x) ((x) / (f->config->msPerTick))
 
 // Fixed-point calculations
 #define fix(x)      (x * 1000000)
 #define unfixflr(x) (x / 1000000)
 #define unfixfrc(x) (x % 1000000)
 
+// The following are engine routines shared with the move generator. See
+// `engine.c` for documentation.
+bool fsIsMaskCollision(const FSEngine *f, const FSPieceMask *m, int x, int y);
+int fsHardDropY(const FSEngine *f, const FSPieceMask *m, int x, int y);
+bool fsTryRotate(const FSEngine *f, FSBlock piece, int x, int y, int theta,
+                 int direction, i8x3 *dst, bool *floorkick);
+
 #endif // FS_INTERNAL_H
@@ -0,0 +1,170 @@
+///
+// latency.c
+// =========
+//
+// Latency histograms with logarithmic buckets.
+//
+// Values below `FS_LATENCY_LINEAR` have a bucket each. Above that each power
+// of two is split into `FS_LATENCY_SUB_BUCKETS` equal buckets, so recording is
+// constant time and the relative error of a percentile is bounded.
+///
+
+#ifndef FS_DISABLE_LATENCY
+
+#include <stdio.h>
+#include <string.h>
+
+#include "engine.h"
+#include "latency.h"
+#include "log.h"
+
+static int highestBit(u32 x)
+{
+    int n = 0;
+    while (x >>= 1) {
+        n += 1;
+    }
+    return n;
+}
+
+static int bucketIndex(i32 value)
+{
+    if (value < FS_LATENCY_LINEAR) {
+        return value < 0 ? 0 : value;
+    }
+
+    const int msb = highestBit(value);
+    const int shift = msb - 4;
+    return FS_LATENCY_LINEAR + (msb - 5) * FS_LATENCY_SUB_BUCKETS +
+           ((value >> shift) & (FS_LATENCY_SUB_BUCKETS - 1));
+}
+
+///
+// Return the largest value counted by a bucket.
+///
+static i32 bucketLimit(int index)
+{
+    if (index < FS_LATENCY_LINEAR) {
+        return index;
+    }
+
+    const int octave = (index - FS_LATENCY_LINEAR) / FS_LATENCY_SUB_BUCKETS;
+    const int sub = (index - FS_LATENCY_LINEAR) % FS_LATENCY_SUB_BUCKETS;
+    const int shift = octave + 1;
+    const u32 low = (u32) (FS_LATENCY_SUB_BUCKETS + sub) << shift;
+    return (i32) (low + ((u32) 1 << shift) - 1);
+}
+
+static void record(FSLatencyHistogram *h, i32 value)
+{
+    if (value < 0) {
+        value = 0;
+    }
+
+    h->buckets[bucketIndex(value)] += 1;
+    h->count += 1;
+    if (value > h->max) {
+        h->max = value;
+    }
+}
+
+void fsLatencyInit(FSLatency *l)
+{
+    memset(l, 0, sizeof(*l));
+}
+
+void fsLatencyConsume(FSLatency *l, i32 readTime, i32 tickTime)
+{
+    record(&l->readToTick, fsTimeDiff(tickTime, readTime));
+
+    if (l->pendingCount == FS_MAX_KEY_EVENTS) {
+        l->dropped += 1;
+        return;
+    }
+
+    l->pendingRead[l->pendingCount] = readTime;
+    l->pendingTick[l->pendingCount] = tickTime;
+    l->pendingCount += 1;
+}
+
+void fsLatencyBlit(FSLatency *l, i32 blitTime)
+{
+    for (i32 i = 0; i < l->pendingCount; ++i) {
+        record(&l->tickToBlit, fsTimeDiff(blitTime, l->pendingTick[i]));
+        record(&l->readToBlit, fsTimeDiff(blitTime, l->pendingRead[i]));
+    }
+
+    l->pendingCount = 0;
+}
+
+i32 fsLatencyPercentile(const FSLatencyHistogram *h, int percentile)
+{
+    // The smallest rank which has `percentile` percent of values at or below.
+    const u32 rank = ((uint64_t) h->count * percentile + 99) / 100;
+    u32 seen = 0;
+
+    if (h->count == 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < FS_LATENCY_BUCKETS; ++i) {
+        seen += h->buckets[i];
+        if (seen >= rank && seen > 0) {
+            const i32 limit = bucketLimit(i);
+            return limit < h->max ? limit : h->max;
+        }
+    }
+
+    return h->max;
+}
+
+static const struct {
+    const char *name;
+    size_t offset;
+} stages[] = {
+    { "read-tick", offsetof(FSLatency, readToTick) },
+    { "tick-blit", offsetof(FSLatency, tickToBlit) },
+    { "read-blit", offsetof(FSLatency, readToBlit) },
+};
+
+#define STAGE(l, i) ((const FSLatencyHistogram *) ((const char *) (l) + stages[i].offset))
+
+void fsLatencyLog(const FSLatency *l)
+{
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); ++i) {
+        const FSLatencyHistogram *h = STAGE(l, i);
+        fsLogInfo("latency %s: n=%u p50=%dus p99=%dus max=%dus", stages[i].name,
+                  h->count, fsLatencyPercentile(h, 50), fsLatencyPercentile(h, 99),
+                  h->max);
+    }
+
+    if (l->dropped) {
+        fsLogInfo("latency: %u key changes not measured", l->dropped);
+    }
+}
+
+void fsLatencyWriteCsv(const FSLatency *l, const FSEngine *f, const char *path)
+{
+    FILE *fd = fopen(path, "a");
+    if (!fd) {
+        fsLogWarning("could not open latency file %s", path);
+        return;
+    }
+
+    // Only a new file needs the header.
+    fseek(fd, 0, SEEK_END);
+    if (ftell(fd) == 0) {
+        fprintf(fd, "stage,count,p50,p99,max,ms_per_tick,ticks_per_draw,draw_rate\n");
+    }
+
+    for (size_t i = 0; i < sizeof(stages) / sizeof(stages[0]); ++i) {
+        const FSLatencyHistogram *h = STAGE(l, i);
+        fprintf(fd, "%s,%u,%d,%d,%d,%d,%d,%d\n", stages[i].name, h->count,
+                fsLatencyPercentile(h, 50), fsLatencyPercentile(h, 99), h->max,
+                f->config->msPerTick, f->config->ticksPerDraw, f->config->drawRate);
+    }
+
+    fclose(fd);
+}
+
+#endif // FS_DISABLE_LATENCY
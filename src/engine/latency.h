@@ -0,0 +1,101 @@
+///
+// latency.h
+// =========
+//
+// Input latency instrumentation.
+//
+// Each key change is timestamped when it occurred, when a tick consumed it and
+// when the frame showing its result was flushed to the display. The delays
+// between these are kept as histograms which can be summarised at the end of
+// a game.
+//
+// This is an optional component. It can be turned off with the flag
+// `FS_DISABLE_LATENCY`.
+///
+
+#ifndef FS_LATENCY_H
+#define FS_LATENCY_H
+
+#include "config.h"
+#include "core.h"
+
+// Values below this are counted exactly, in 1 us buckets.
+#define FS_LATENCY_LINEAR 32
+
+// Number of buckets each power of two is split into above the linear range.
+// Each bucket is within 1/16th (~6%) of the values it counts.
+#define FS_LATENCY_SUB_BUCKETS 16
+
+// Enough buckets to count any positive i32.
+#define FS_LATENCY_BUCKETS \
+    (FS_LATENCY_LINEAR + (31 - 5) * FS_LATENCY_SUB_BUCKETS)
+
+///
+// A histogram of latencies in microseconds.
+///
+struct FSLatencyHistogram {
+    /// Number of values counted.
+    u32 count;
+
+    /// Largest value counted.
+    i32 max;
+
+    /// Number of values counted in each bucket.
+    u32 buckets[FS_LATENCY_BUCKETS];
+};
+
+struct FSLatency {
+    /// Time from a key change occurring to a tick consuming it.
+    FSLatencyHistogram readToTick;
+
+    /// Time from a tick consuming a key change to the next flushed frame.
+    FSLatencyHistogram tickToBlit;
+
+    /// Time from a key change occurring to the next flushed frame.
+    FSLatencyHistogram readToBlit;
+
+    /// Key changes consumed by a tick which have not been drawn yet.
+    i32 pendingRead[FS_MAX_KEY_EVENTS];
+    i32 pendingTick[FS_MAX_KEY_EVENTS];
+    i32 pendingCount;
+
+    /// Key changes not measured because too many were waiting for a frame.
+    u32 dropped;
+};
+
+#ifndef FS_DISABLE_LATENCY
+
+// Clear all recorded latencies.
+void fsLatencyInit(FSLatency *l);
+
+// Record that a tick at `tickTime` consumed a key change which occurred at
+// `readTime`. Times are in microseconds on the `fsiGetTime` clock.
+void fsLatencyConsume(FSLatency *l, i32 readTime, i32 tickTime);
+
+// Record that a frame was flushed at `blitTime`, completing every consumed
+// key change.
+void fsLatencyBlit(FSLatency *l, i32 blitTime);
+
+// Return an upper bound of the specified percentile of a histogram.
+i32 fsLatencyPercentile(const FSLatencyHistogram *h, int percentile);
+
+// Write a summary of each histogram to the log.
+void fsLatencyLog(const FSLatency *l);
+
+// Append a summary of each histogram for the game to a CSV file.
+void fsLatencyWriteCsv(const FSLatency *l, const FSEngine *f, const char *path);
+
+#else
+
+// Arguments are still evaluated so variables only used for measuring latency
+// are not reported as unused.
+#define fsLatencyInit(l) ((void) (l))
+#define fsLatencyConsume(l, readTime, tickTime) \
+    ((void) (l), (void) (readTime), (void) (tickTime))
+#define fsLatencyBlit(l, blitTime) ((void) (l), (void) (blitTime))
+#define fsLatencyLog(l) ((void) (l))
+#define fsLatencyWriteCsv(l, f, path) ((void) (l), (void) (f), (void) (path))
+
+#endif // FS_DISABLE_LATENCY
+
+#endif // FS_LATENCY_H
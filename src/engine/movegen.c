@@ -0,0 +1,239 @@
+///
+// movegen.c
+// =========
+//
+// Breadth-first placement search.
+//
+// Every visited position is stored in a fixed node array which doubles as the
+// search queue. The parent index of each node is kept so the path to any
+// placement can be recovered without storing it per node.
+///
+
+#include "engine.h"
+#include "internal.h"
+#include "movegen.h"
+#include "rotation.h"
+
+// Number of distinct positions a piece can occupy. A position is only valid
+// if its bounding box lies within the field, so x and y can be no less than
+// -FS_ROW_PAD.
+#define POS_ROWS (FS_MAX_HEIGHT + FS_ROW_PAD)
+#define MAX_NODES (FS_NPR * POS_ROWS * (FS_MAX_WIDTH + FS_ROW_PAD))
+
+typedef struct {
+    i8 x;
+    i8 y;
+    i8 theta;
+
+    /// Number of floorkicks performed to reach this position.
+    i8 floorkicks;
+
+    /// Is the floorkick limit exceeded, forcing the piece to lock on landing.
+    bool locked;
+
+    /// Move performed from the parent to reach this position.
+    i8 move;
+
+    /// Number of moves from the starting position.
+    u8 depth;
+
+    /// Index of the parent node, or -1 for the starting position.
+    i16 parent;
+} Node;
+
+typedef struct {
+    const FSEngine *f;
+
+    /// Nodes in order of discovery.
+    Node nodes[MAX_NODES];
+    i32 count;
+
+    /// Visited positions, bit `x + FS_ROW_PAD` of [theta][y + FS_ROW_PAD].
+    FSRowMask seen[FS_NPR][POS_ROWS];
+
+    /// Positions already returned as a placement.
+    FSRowMask placed[FS_NPR][POS_ROWS];
+
+    /// Lowest row reachable by falling from [theta][y][x], or DROP_UNKNOWN.
+    i8 drop[FS_NPR][POS_ROWS][FS_MAX_WIDTH + FS_ROW_PAD];
+} Search;
+
+#define DROP_UNKNOWN 0x7f
+
+static bool testAndSet(FSRowMask set[FS_NPR][POS_ROWS], int x, int y, int theta)
+{
+    FSRowMask *row = &set[theta][y + FS_ROW_PAD];
+    const FSRowMask bit = (FSRowMask) 1 << (x + FS_ROW_PAD);
+
+    if (*row & bit) {
+        return true;
+    }
+
+    *row |= bit;
+    return false;
+}
+
+static void push(Search *s, i16 parent, i8 move, int x, int y, int theta,
+                 int floorkicks, bool locked)
+{
+    if (testAndSet(s->seen, x, y, theta)) {
+        return;
+    }
+
+    Node *n = &s->nodes[s->count++];
+    n->x = x;
+    n->y = y;
+    n->theta = theta;
+    n->floorkicks = floorkicks;
+    n->locked = locked;
+    n->move = move;
+    n->depth = parent >= 0 ? s->nodes[parent].depth + 1 : 0;
+    n->parent = parent;
+}
+
+///
+// Return the lowest row the piece can fall to from the specified position.
+//
+// Every position passed on the way down shares the same result, so each is
+// cached to avoid probing a column again for every node above the stack.
+///
+static int dropRow(Search *s, const FSPieceMask *m, int x, int y, int theta)
+{
+    i8 *column = &s->drop[theta][0][x + FS_ROW_PAD];
+    const int stride = FS_MAX_WIDTH + FS_ROW_PAD;
+
+    if (column[(y + FS_ROW_PAD) * stride] != DROP_UNKNOWN) {
+        return column[(y + FS_ROW_PAD) * stride];
+    }
+
+    const int dropY = fsHardDropY(s->f, m, x, y);
+    for (int r = y; r <= dropY; ++r) {
+        column[(r + FS_ROW_PAD) * stride] = dropY;
+    }
+
+    return dropY;
+}
+
+static void emitPlacement(const Search *s, i16 index, FSPlacement *p)
+{
+    const Node *n = &s->nodes[index];
+
+    p->x = n->x;
+    p->y = n->y;
+    p->theta = n->theta;
+    p->pathLength = n->depth;
+
+    for (int i = n->depth - 1; i >= 0; --i) {
+        p->path[i] = n->move;
+        n = &s->nodes[n->parent];
+    }
+}
+
+static void tryRotation(Search *s, i16 index, i8 move, int direction)
+{
+    const FSEngine *f = s->f;
+    const Node *n = &s->nodes[index];
+    i8x3 pos;
+    bool floorkick;
+
+    if (!fsTryRotate(f, f->piece, n->x, n->y, n->theta, direction, &pos, &floorkick)) {
+        return;
+    }
+
+    // Mirror the floorkick accounting performed by the engine.
+    int floorkicks = n->floorkicks;
+    bool locked = false;
+    if (f->config->floorkickLimit && floorkick) {
+        locked = floorkicks++ >= f->config->floorkickLimit;
+    }
+
+    push(s, index, move, pos.x, pos.y, pos.z, floorkicks, locked);
+}
+
+///
+// Search from the current piece position.
+//
+// If `singleRows` is false the piece only falls by dropping to the stack, so
+// positions part way down a column are never expanded.
+///
+static i32 generate(const FSEngine *f, FSPlacement *dst, i32 capacity, bool singleRows)
+{
+    const FSPieceMask *masks;
+    Search s;
+    i32 found = 0;
+
+    if (f->piece == FS_NONE) {
+        return 0;
+    }
+
+    masks = pieceMasks[f->config->rotationSystem][f->piece];
+    if (fsIsMaskCollision(f, &masks[f->theta], f->x, f->y)) {
+        return 0;
+    }
+
+    s.f = f;
+    s.count = 0;
+
+    // Only the rows of the field in use are ever visited, so the tables are
+    // not cleared past them.
+    const int rows = f->config->fieldHeight + FS_ROW_PAD;
+    for (int theta = 0; theta < FS_NPR; ++theta) {
+        memset(s.seen[theta], 0, rows * sizeof(s.seen[0][0]));
+        memset(s.placed[theta], 0, rows * sizeof(s.placed[0][0]));
+        memset(s.drop[theta], DROP_UNKNOWN, rows * sizeof(s.drop[0][0]));
+    }
+
+    push(&s, -1, 0, f->x, f->y, f->theta, f->floorkickCount, false);
+
+    for (i16 i = 0; i < s.count; ++i) {
+        const Node n = s.nodes[i];
+        const FSPieceMask *m = &masks[n.theta];
+
+        const int dropY = dropRow(&s, m, n.x, n.y, n.theta);
+
+        if (dropY == n.y) {
+            if (found < capacity && !testAndSet(s.placed, n.x, n.y, n.theta)) {
+                emitPlacement(&s, i, &dst[found++]);
+            }
+        }
+
+        if (n.depth == FS_MAX_PATH_LEN) {
+            continue;
+        }
+
+        if (dropY != n.y) {
+            if (singleRows) {
+                push(&s, i, FST_MOVE_DOWN, n.x, n.y + 1, n.theta, n.floorkicks, n.locked);
+            }
+            push(&s, i, FST_MOVE_DROP, n.x, dropY, n.theta, n.floorkicks, n.locked);
+        }
+
+        // A locked piece can only fall to the stack.
+        if (n.locked) {
+            continue;
+        }
+
+        if (!fsIsMaskCollision(f, m, n.x - 1, n.y)) {
+            push(&s, i, FST_MOVE_LEFT, n.x - 1, n.y, n.theta, n.floorkicks, false);
+        }
+        if (!fsIsMaskCollision(f, m, n.x + 1, n.y)) {
+            push(&s, i, FST_MOVE_RIGHT, n.x + 1, n.y, n.theta, n.floorkicks, false);
+        }
+
+        tryRotation(&s, i, FST_MOVE_ROTR, FST_ROT_CLOCKWISE);
+        tryRotation(&s, i, FST_MOVE_ROTL, FST_ROT_ANTICLOCKWISE);
+        tryRotation(&s, i, FST_MOVE_ROTH, FST_ROT_HALFTURN);
+    }
+
+    return found;
+}
+
+i32 fsGeneratePlacements(const FSEngine *f, FSPlacement *dst, i32 capacity)
+{
+    return generate(f, dst, capacity, true);
+}
+
+i32 fsGenerateDropPlacements(const FSEngine *f, FSPlacement *dst, i32 capacity)
+{
+    return generate(f, dst, capacity, false);
+}
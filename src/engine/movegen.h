@@ -0,0 +1,103 @@
+///
+// movegen.h
+// =========
+//
+// Enumerates every resting placement reachable by the current piece.
+//
+// Placements are found by a breadth-first search over piece positions using
+// the same collision and rotation routines as the engine itself, so any
+// kicks, floorkick limits and TGM rotation conditions of the active rotation
+// system are respected.
+//
+// The following are not modelled:
+//  * Gravity. Moves are assumed to be input faster than the piece falls.
+//  * Lock delay. A piece can be moved indefinitely while on the stack.
+//  * Hold, IRS and IHS.
+///
+
+#ifndef FS_MOVEGEN_H
+#define FS_MOVEGEN_H
+
+#include "config.h"
+#include "core.h"
+
+///
+// A single step of a placement path.
+///
+enum MoveType {
+    /// Move the piece one column left.
+    FST_MOVE_LEFT,
+
+    /// Move the piece one column right.
+    FST_MOVE_RIGHT,
+
+    /// Rotate the piece clockwise.
+    FST_MOVE_ROTR,
+
+    /// Rotate the piece anticlockwise.
+    FST_MOVE_ROTL,
+
+    /// Rotate the piece 180 degrees.
+    FST_MOVE_ROTH,
+
+    /// Move the piece down a single row.
+    FST_MOVE_DOWN,
+
+    /// Move the piece down until it rests on the stack, without locking.
+    FST_MOVE_DROP
+};
+
+///
+// A final resting position of a piece.
+///
+struct FSPlacement {
+    /// Position and rotation state the piece locks at.
+    i8 x;
+    i8 y;
+    i8 theta;
+
+    /// Number of moves stored in `path`.
+    u8 pathLength;
+
+    /// Moves (`FST_MOVE_*`) from the starting position to the placement. A
+    /// hard drop is implied after the final move.
+    i8 path[FS_MAX_PATH_LEN];
+};
+
+///
+// Generate every placement reachable by the current piece of an engine.
+//
+// The search starts from the current piece position and floorkick count.
+// Each (x, y, theta) position is only visited once, by its shortest path. No
+// heap allocation is performed.
+//
+//  * const FSEngine *f
+//      The engine to search. This must have an active piece.
+//
+//  * FSPlacement *dst
+//      Buffer to store the placements in.
+//
+//  * i32 capacity
+//      Number of entries in `dst`. Any further placements are discarded.
+//
+// Returns the number of placements stored.
+//
+// Every row a piece passes through is expanded, so this takes around 50us on
+// an empty 10 wide SRS field. Each position is tested with the collision and
+// kick routines of the engine rather than a bitboard search, which is what
+// keeps the results exact for every rotation system.
+///
+i32 fsGeneratePlacements(const FSEngine *f, FSPlacement *dst, i32 capacity);
+
+///
+// Generate the placements reachable when the piece only falls by dropping to
+// the stack.
+//
+// This is intended for bots. Moves and rotations are only tried at the
+// starting row and once the piece has landed, so placements which need a
+// move part way down a column are not found. This takes around 7us on an
+// empty 10 wide SRS field. Arguments and result are as `fsGeneratePlacements`.
+///
+i32 fsGenerateDropPlacements(const FSEngine *f, FSPlacement *dst, i32 capacity);
+
+#endif // FS_MOVEGEN_H
@@ -3,7 +3,7 @@
 // ========
 //
 // Handle parsing of configuration files and the associated setting of value
-// within a `FSEngine` instance.
+// within a `FSEngineConfig` instance.
 //
 // We make heavy macro usage in order to get thorough input-checking for values
 // across a number of types. Will likely be slightly adjusted if we move hasing
@@ -35,6 +35,11 @@ void fsiAddToKeymap(FSFrontend *v, const int vkey, const char *key, bool isDefau
 #define MAX_LINE_LENGTH 512
 #define MAX_ID_LENGTH 32
 
+// Set if the last auto repeat rate read was the old `dasSpeed` option, which
+// is measured in ticks. It is converted once the whole file is read since
+// `msPerTick` may follow it.
+static bool legacyDasSpeed;
+
 int strcmpi(const char *a, const char *b)
 {
     for (;; a++, b++) {
@@ -127,18 +132,24 @@ static void unpackOptionValue(struct FSFrontend *p, FSView *v, const char *k,
 {
     if (!strncmp(k, "game.", 5)) {
         const char *key = k + 5;
-        FSEngine *dst = v->game;
+        FSEngineConfig *dst = v->config;
 
         TS_BOOL      (warnOnBadFinesse);
         TS_INT       (areDelay);
         TS_BOOL      (areCancellable);
-        TS_INT       (dasSpeed);
-        TS_INT       (dasDelay);
+        if (!strcmpi(key, "arrUs") || !strcmpi(key, "dasSpeed")) {
+            legacyDasSpeed = !strcmpi(key, "dasSpeed");
+        }
+
+        TS_INT_RANGE_AS (arrUs, dasSpeed, 0, INT_MAX);
+        TS_INT_RANGE (dasSpeed, 0, INT_MAX);
+        TS_INT_RANGE (dasDelay, 0, INT_MAX / 1000);
         TS_INT       (lockDelay);
         TS_INT_FUNC  (randomizer, fsRandomizerLookup);
         TS_INT_FUNC  (rotationSystem, fsRotationSystemLookup);
         TS_INT_RANGE (msPerTick, 1, INT_MAX);
         TS_INT_RANGE (ticksPerDraw, 1, INT_MAX);
+        TS_INT_RANGE (drawRate, 0, 1000000);
         TS_INT_RANGE (fieldHidden, 0, FS_MAX_HEIGHT);
         TS_INT_RANGE (fieldHeight, 0, FS_MAX_HEIGHT);
         TS_INT_RANGE (fieldWidth, 0, FS_MAX_WIDTH);
@@ -148,7 +159,7 @@ static void unpackOptionValue(struct FSFrontend *p, FSView *v, const char *k,
         TS_BOOL      (oneShotSoftDrop);
         TS_INT       (readyPhaseLength);
         TS_INT       (goPhaseLength);
-        TS_INT       (nextPieceCount);
+        TS_INT_RANGE (nextPieceCount, 0, FS_MAX_PREVIEW_COUNT);
         TS_INT       (goal);
         TS_INT_RANGE (gravity, 0, INT_MAX);
         TS_INT_RANGE (softDropGravity, 0, INT_MAX);
@@ -188,6 +199,9 @@ const char *usage =
 "Options:\n"
 "   -h --help       Display this message and quit\n"
 "   -i --no-ini     Do not load options from the configuration file\n"
+"   --latency[=FILE]\n"
+"                   Log input latency (with -v) at the end of each game,\n"
+"                   appending it to FILE as CSV if given\n"
 "   -v              Increase the logging level\n";
 
 ///
@@ -221,6 +235,13 @@ void fsParseOptString(FSOptions *o, int argc, char **argv)
             printf("%s\n", usage);
             exit(0);
         }
+        else if (!strcmp("--latency", opt)) {
+            o->latency = true;
+        }
+        else if (!strncmp("--latency=", opt, 10)) {
+            o->latency = true;
+            o->latencyFile = (char*) opt + 10;
+        }
         else if (!strcmp("--db-path", opt)) {
             printf("%s\n", daoGetDatabasePath());
             exit(0);
@@ -318,6 +339,8 @@ void fsParseIniFile(struct FSFrontend *p, FSView *v, const char *fname)
     char value[MAX_ID_LENGTH] = {0};
     int line = 0;
 
+    legacyDasSpeed = false;
+
     while (fgets(buffer, MAX_LINE_LENGTH, fd)) {
         char *s = buffer;
         eat_space(&s);
@@ -395,6 +418,15 @@ void fsParseIniFile(struct FSFrontend *p, FSView *v, const char *fname)
     }
 
     fclose(fd);
+
+    if (legacyDasSpeed) {
+        FSEngineConfig *c = v->config;
+        const long long arr = (long long) c->dasSpeed * c->msPerTick * 1000;
+
+        c->dasSpeed = arr < INT_MAX ? arr : INT_MAX;
+        fsLogWarning("dasSpeed is measured in ticks and has been replaced by "
+                     "arrUs. Using arrUs = %d", c->dasSpeed);
+    }
 }
 
 ///
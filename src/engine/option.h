@@ -25,6 +25,8 @@ struct FSOptions {
     int verbosity;
     bool no_ini;
     char *replay;
+    bool latency;
+    char *latencyFile;
 };
 
 int strcmpi(const char *a, const char *b);
@@ -76,9 +78,12 @@ inline static u32 cilog2(long long x)
 
 #define TS_INT(_id) TS_INT_RANGE(_id, 0, LLONG_MAX)
 
-#define TS_INT_RANGE(_id, _lo, _hi)                                             \
+#define TS_INT_RANGE(_id, _lo, _hi) TS_INT_RANGE_AS(_id, _id, _lo, _hi)
+
+// Set `_id` from the option named `_name`.
+#define TS_INT_RANGE_AS(_name, _id, _lo, _hi)                                   \
 do {                                                                            \
-    if (!strcmpi(#_id, key)) {                                                  \
+    if (!strcmpi(#_name, key)) {                                                \
         errno = 0;                                                              \
         char *_endptr;                                                          \
         const long long _ival = strtoll(value, &_endptr, 10);                   \
@@ -158,6 +163,7 @@ do {
 
 #define TS_INT(_id)
 #define TS_INT_RANGE(_id, _lo, _hi)
+#define TS_INT_RANGE_AS(_name, _id, _lo, _hi)
 #define TS_INT_FUNC(_id, _func)
 #define TS_BOOL(_id)
 #define TS_KEY(_id, _vkey)
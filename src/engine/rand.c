@@ -24,6 +24,15 @@
 #include <time.h>
 #endif
 
+// The intrinsic headers pull in the C library so are only used when hosted.
+#if __STDC_HOSTED__ == 1 && defined(__AVX2__)
+#include <immintrin.h>
+#define FS_RAND_AVX2
+#elif __STDC_HOSTED__ == 1 && defined(__SSE2__)
+#include <emmintrin.h>
+#define FS_RAND_SSE2
+#endif
+
 ///
 // Return a decent seed value.
 //
@@ -52,6 +61,67 @@ u32 fsRandNext(FSRandCtx *ctx)
 #undef R
 }
 
+///
+// Generate the next value for every lane of this PRNG context.
+//
+// This performs the same operations as `fsRandNext` on whole vectors. The
+// instruction set is chosen at compile-time.
+void fsRandLanesNext(FSRandLanes *ctx, u32 out[FS_RAND_LANES])
+{
+#if defined(FS_RAND_AVX2)
+#define R(x, k) _mm256_or_si256(_mm256_slli_epi32(x, k), _mm256_srli_epi32(x, 32 - (k)))
+    __m256i a = _mm256_loadu_si256((const __m256i *) ctx->a);
+    __m256i b = _mm256_loadu_si256((const __m256i *) ctx->b);
+    __m256i c = _mm256_loadu_si256((const __m256i *) ctx->c);
+    __m256i d = _mm256_loadu_si256((const __m256i *) ctx->d);
+
+    const __m256i e = _mm256_sub_epi32(a, R(b, 27));
+    a = _mm256_xor_si256(b, R(c, 17));
+    b = _mm256_add_epi32(c, d);
+    c = _mm256_add_epi32(d, e);
+    d = _mm256_add_epi32(e, a);
+
+    _mm256_storeu_si256((__m256i *) ctx->a, a);
+    _mm256_storeu_si256((__m256i *) ctx->b, b);
+    _mm256_storeu_si256((__m256i *) ctx->c, c);
+    _mm256_storeu_si256((__m256i *) ctx->d, d);
+    _mm256_storeu_si256((__m256i *) out, d);
+#undef R
+#elif defined(FS_RAND_SSE2)
+#define R(x, k) _mm_or_si128(_mm_slli_epi32(x, k), _mm_srli_epi32(x, 32 - (k)))
+    for (int i = 0; i < FS_RAND_LANES; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *) &ctx->a[i]);
+        __m128i b = _mm_loadu_si128((const __m128i *) &ctx->b[i]);
+        __m128i c = _mm_loadu_si128((const __m128i *) &ctx->c[i]);
+        __m128i d = _mm_loadu_si128((const __m128i *) &ctx->d[i]);
+
+        const __m128i e = _mm_sub_epi32(a, R(b, 27));
+        a = _mm_xor_si128(b, R(c, 17));
+        b = _mm_add_epi32(c, d);
+        c = _mm_add_epi32(d, e);
+        d = _mm_add_epi32(e, a);
+
+        _mm_storeu_si128((__m128i *) &ctx->a[i], a);
+        _mm_storeu_si128((__m128i *) &ctx->b[i], b);
+        _mm_storeu_si128((__m128i *) &ctx->c[i], c);
+        _mm_storeu_si128((__m128i *) &ctx->d[i], d);
+        _mm_storeu_si128((__m128i *) &out[i], d);
+    }
+#undef R
+#else
+#define R(x, k) (((x) << (k)) | ((x) >> (32 - (k))))
+    for (int i = 0; i < FS_RAND_LANES; ++i) {
+        const u32 e = ctx->a[i] - R(ctx->b[i], 27);
+        ctx->a[i] = ctx->b[i] ^ R(ctx->c[i], 17);
+        ctx->b[i] = ctx->c[i] + ctx->d[i];
+        ctx->c[i] = ctx->d[i] + e;
+        ctx->d[i] = e + ctx->a[i];
+        out[i] = ctx->d[i];
+    }
+#undef R
+#endif
+}
+
 ///
 // Generate an unbiased integer within the range [low, high).
 static u32 fsRandInRange(FSRandCtx *ctx, u32 low, u32 high)
@@ -78,6 +148,31 @@ void fsRandSeed(FSRandCtx *ctx, u32 seed)
     }
 }
 
+///
+// Seed every lane of the randomizer.
+void fsRandLanesSeed(FSRandLanes *ctx, const u32 seed[FS_RAND_LANES])
+{
+    u32 discard[FS_RAND_LANES];
+
+    for (int i = 0; i < FS_RAND_LANES; ++i) {
+        ctx->a[i] = 0xf1ea5eed;
+        ctx->b[i] = ctx->c[i] = ctx->d[i] = seed[i];
+    }
+    for (int i = 0; i < 20; ++i) {
+        fsRandLanesNext(ctx, discard);
+    }
+}
+
+///
+// Extract a single lane to continue its sequence with the scalar functions.
+void fsRandLanesGet(const FSRandLanes *ctx, int lane, FSRandCtx *dst)
+{
+    dst->a = ctx->a[lane];
+    dst->b = ctx->b[lane];
+    dst->c = ctx->c[lane];
+    dst->d = ctx->d[lane];
+}
+
 ///
 // Perform an unbiased shuffle.
 ///
@@ -99,37 +194,37 @@ static void fisherYatesShuffle(FSRandCtx *ctx, FSBlock *a, int n)
 //
 // This can be used for sub-single bag randomizers.
 ///
-static void initBag(FSEngine *f)
+static void initBag(FSRandCtx *ctx, FSRandState *s)
 {
-    f->randBufIndex = 0;
+    s->index = 0;
     for (int i = 0; i < FS_NPT; ++i) {
-        f->randBuf[i] = i;
+        s->buf[i] = i;
     }
 
     do {
-        fisherYatesShuffle(&f->randomContext, f->randBuf, FS_NPT);
+        fisherYatesShuffle(ctx, s->buf, FS_NPT);
         // Discard S, Z, O pieces
-    } while (f->randBuf[0] == FS_S ||
-             f->randBuf[0] == FS_Z ||
-             f->randBuf[0] == FS_O);
+    } while (s->buf[0] == FS_S ||
+             s->buf[0] == FS_Z ||
+             s->buf[0] == FS_O);
 }
 
 // `length` **MUST** be less than `FS_NPT`.
-static FSBlock fromBag(FSEngine *f, int length, bool checkSeam)
+static FSBlock fromBag(FSRandCtx *ctx, FSRandState *s, int length, bool checkSeam)
 {
-    const FSBlock b = f->randBuf[f->randBufIndex];
-    if (++f->randBufIndex == length) {
-        f->randBufIndex = 0;
-        fisherYatesShuffle(&f->randomContext, f->randBuf, FS_NPT);
+    const FSBlock b = s->buf[s->index];
+    if (++s->index == length) {
+        s->index = 0;
+        fisherYatesShuffle(ctx, s->buf, FS_NPT);
 
         if (checkSeam) {
             // If there was a duplicate across seams, swap the head with a
             // random another random piece in the bag.
-            if (b == f->randBuf[f->randBufIndex]) {
-                const int index = fsRandInRange(&f->randomContext, 1, FS_NPT);
-                const FSBlock tmp = f->randBuf[index];
-                f->randBuf[index] = f->randBuf[0];
-                f->randBuf[0] = tmp;
+            if (b == s->buf[s->index]) {
+                const int index = fsRandInRange(ctx, 1, FS_NPT);
+                const FSBlock tmp = s->buf[index];
+                s->buf[index] = s->buf[0];
+                s->buf[0] = tmp;
             }
         }
     }
@@ -143,27 +238,27 @@ static FSBlock fromBag(FSEngine *f, int length, bool checkSeam)
 // Implements a set of bag randomizer combined then shuffled. This increases
 // the variance between pieces while still retaining some semblance of
 // determinism.
-static void initMultiBag(FSEngine *f, int bagCount)
+static void initMultiBag(FSRandCtx *ctx, FSRandState *s, int bagCount)
 {
-    f->randBufIndex = 0;
+    s->index = 0;
     for (int i = 0; i < bagCount * FS_NPT; ++i) {
-        f->randBuf[i] = i % FS_NPT;
+        s->buf[i] = i % FS_NPT;
     }
 
     do {
-        fisherYatesShuffle(&f->randomContext, f->randBuf, bagCount * FS_NPT);
+        fisherYatesShuffle(ctx, s->buf, bagCount * FS_NPT);
         // Discard S, Z, O pieces
-    } while (f->randBuf[0] == FS_S ||
-             f->randBuf[0] == FS_Z ||
-             f->randBuf[0] == FS_O);
+    } while (s->buf[0] == FS_S ||
+             s->buf[0] == FS_Z ||
+             s->buf[0] == FS_O);
 }
 
-static FSBlock fromMultiBag(FSEngine *f, int bagCount)
+static FSBlock fromMultiBag(FSRandCtx *ctx, FSRandState *s, int bagCount)
 {
-    const FSBlock b = f->randBuf[f->randBufIndex];
-    if (++f->randBufIndex == bagCount * FS_NPT) {
-        f->randBufIndex = 0;
-        fisherYatesShuffle(&f->randomContext, f->randBuf, bagCount * FS_NPT);
+    const FSBlock b = s->buf[s->index];
+    if (++s->index == bagCount * FS_NPT) {
+        s->index = 0;
+        fisherYatesShuffle(ctx, s->buf, bagCount * FS_NPT);
     }
 
     return b;
@@ -175,10 +270,9 @@ static FSBlock fromMultiBag(FSEngine *f, int bagCount)
 // A simple randomizer just generates a random number with no knowledge
 // of what comes before or after it.
 ///
-static FSBlock fromSimple(FSEngine *f)
+static FSBlock fromSimple(FSRandCtx *ctx)
 {
-    (void) f;
-    return fsRandInRange(&f->randomContext, 0, FS_NPT);
+    return fsRandInRange(ctx, 0, FS_NPT);
 }
 
 ///
@@ -188,44 +282,44 @@ static FSBlock fromSimple(FSEngine *f)
 //
 // The extra field is used to handle the first roll special case.
 ///
-static void initTGM1(FSEngine *f)
+static void initTGM1(FSRandState *s)
 {
-    f->randBuf[0] = FS_Z;
-    f->randBuf[1] = FS_Z;
-    f->randBuf[2] = FS_Z;
-    f->randBuf[3] = FS_Z;
-    f->randBufIndex = 0;
-    f->randBufExtra[0] = 0;
+    s->buf[0] = FS_Z;
+    s->buf[1] = FS_Z;
+    s->buf[2] = FS_Z;
+    s->buf[3] = FS_Z;
+    s->index = 0;
+    s->extra[0] = 0;
 }
 
 // TODO: Wrong variance calculated for TGM2 6 roll variant.
-static FSBlock fromTGM1or2(FSEngine *f, int noOfRolls)
+static FSBlock fromTGM1or2(FSRandCtx *ctx, FSRandState *s, int noOfRolls)
 {
     assert(noOfRolls > 0);
 
-    if (!f->randBufExtra[0]) {
-        f->randBufExtra[0] = 1;
+    if (!s->extra[0]) {
+        s->extra[0] = 1;
         const FSBlock choice[] = { FS_J, FS_I, FS_L, FS_T };
-        return choice[fsRandInRange(&f->randomContext, 0, sizeof(choice))];
+        return choice[fsRandInRange(ctx, 0, sizeof(choice))];
     }
 
     FSBlock piece = 0;
     for (int i = 0; i < noOfRolls; ++i) {
         // TODO: 'vectorize' this by generating four pieces at once to speed
         // up by a factor of four/six. Slow for testing.
-        piece = fsRandInRange(&f->randomContext, 0, FS_NPT);
+        piece = fsRandInRange(ctx, 0, FS_NPT);
 
         // If the piece is not in the history then we are done
-        if (piece != f->randBuf[0]
-             && piece != f->randBuf[1]
-             && piece != f->randBuf[2]
-             && piece != f->randBuf[3]) {
+        if (piece != s->buf[0]
+             && piece != s->buf[1]
+             && piece != s->buf[2]
+             && piece != s->buf[3]) {
             break;
         }
     }
 
-    f->randBuf[f->randBufIndex] = piece;
-    f->randBufIndex = (f->randBufIndex + 1) & 3;
+    s->buf[s->index] = piece;
+    s->index = (s->index + 1) & 3;
     return piece;
 }
 
@@ -235,14 +329,14 @@ static FSBlock fromTGM1or2(FSEngine *f, int noOfRolls)
 // This only differs from the TGM1 in the initial history.
 // Reuse the `fromTGM1or2` function to generate pieces.
 ///
-static void initTGM2(FSEngine *f)
+static void initTGM2(FSRandState *s)
 {
-    f->randBuf[0] = FS_Z;
-    f->randBuf[1] = FS_S;
-    f->randBuf[2] = FS_S;
-    f->randBuf[3] = FS_Z;
-    f->randBufIndex = 0;
-    f->randBufExtra[0] = 0;
+    s->buf[0] = FS_Z;
+    s->buf[1] = FS_S;
+    s->buf[2] = FS_S;
+    s->buf[3] = FS_Z;
+    s->index = 0;
+    s->extra[0] = 0;
 }
 
 ///
@@ -257,172 +351,205 @@ static void initTGM2(FSEngine *f)
 //  [11]    = Flag indicating which pieces have been seen for bug emulation
 //  [12]    = Whether this is the first roll
 //
-// The history index uses `randBufIndex`.
-static void initTGM3(FSEngine *f)
+// The history index uses `index`.
+static void initTGM3(FSRandState *s)
 {
     for (int i = 0; i < 35; ++i) {
-        f->randBuf[i] = i % FS_NPT;
+        s->buf[i] = i % FS_NPT;
     }
 
     // Pre-fill history
-    f->randBufExtra[0] = FS_S;
-    f->randBufExtra[1] = FS_Z;
-    f->randBufExtra[2] = FS_S;
-    f->randBufExtra[3] = FS_Z;
-    f->randBufIndex = 0;
+    s->extra[0] = FS_S;
+    s->extra[1] = FS_Z;
+    s->extra[2] = FS_S;
+    s->extra[3] = FS_Z;
+    s->index = 0;
 
     // Pre-fill drought order
-    f->randBufExtra[4]  = FS_J;
-    f->randBufExtra[5]  = FS_I;
-    f->randBufExtra[6]  = FS_Z;
-    f->randBufExtra[7]  = FS_L;
-    f->randBufExtra[8]  = FS_O;
-    f->randBufExtra[9]  = FS_T;
-    f->randBufExtra[10] = FS_S;
+    s->extra[4]  = FS_J;
+    s->extra[5]  = FS_I;
+    s->extra[6]  = FS_Z;
+    s->extra[7]  = FS_L;
+    s->extra[8]  = FS_O;
+    s->extra[9]  = FS_T;
+    s->extra[10] = FS_S;
 
     // Seen count
-    f->randBufExtra[11] = 0;
+    s->extra[11] = 0;
 
     // Is this the first roll?
-    f->randBufExtra[12] = 0;
+    s->extra[12] = 0;
 }
 
 // This is a 6-roll system with bias towards pieces which have not recently
 // dropped.
-static FSBlock fromTGM3(FSEngine *f)
+static FSBlock fromTGM3(FSRandCtx *ctx, FSRandState *s)
 {
     FSBlock piece;
     int index;
 
     // First roll is a special case.
-    if (!f->randBufExtra[12]) {
-        f->randBufExtra[12] = 1;
+    if (!s->extra[12]) {
+        s->extra[12] = 1;
         const FSBlock choice[] = { FS_J, FS_I, FS_L, FS_T };
-        piece = choice[fsRandInRange(&f->randomContext, 0, 4)];
+        piece = choice[fsRandInRange(ctx, 0, 4)];
     }
     else {
         int roll;
         for (roll = 0; roll < 6; ++roll) {
-            index = fsRandInRange(&f->randomContext, 0, 35);
-            piece = f->randBuf[index];
+            index = fsRandInRange(ctx, 0, 35);
+            piece = s->buf[index];
 
             // If the piece is not in the history then we are done
-            if (piece != (FSBlock) f->randBufExtra[0]
-                 && piece != (FSBlock) f->randBufExtra[1]
-                 && piece != (FSBlock) f->randBufExtra[2]
-                 && piece != (FSBlock) f->randBufExtra[3]) {
+            if (piece != (FSBlock) s->extra[0]
+                 && piece != (FSBlock) s->extra[1]
+                 && piece != (FSBlock) s->extra[2]
+                 && piece != (FSBlock) s->extra[3]) {
                 break;
             }
 
             // Update the bag to bias against the current least-common piece.
             if (roll < 5) {
-                f->randBuf[index] = f->randBufExtra[4];
+                s->buf[index] = s->extra[4];
             }
         }
 
         // Mark the piece as seen
-        f->randBufExtra[11] |= (1 << piece);
+        s->extra[11] |= (1 << piece);
 
         // The bag is not updated in the case that every piece has been seen, a
         // reroll occurred on the piece and we just chose the most droughted
         // piece.
         const bool bug = roll > 0 &&
-                   piece == (FSBlock) f->randBufExtra[4] &&
-                   f->randBufExtra[11] == ((1 << 7) - 1);
+                   piece == (FSBlock) s->extra[4] &&
+                   s->extra[11] == ((1 << 7) - 1);
 
         if (!bug) {
-            f->randBuf[index] = f->randBufExtra[4];
+            s->buf[index] = s->extra[4];
         }
 
         // Put current drought piece to back of the drought queue.
         for (int i = 0; i < FS_NPT; ++i) {
-            if (piece == (FSBlock) f->randBufExtra[4 + i]) {
-                memcpy(&f->randBufExtra[4 + i], &f->randBufExtra[5 + i], 6 - i);
-                f->randBufExtra[10] = piece;
+            if (piece == (FSBlock) s->extra[4 + i]) {
+                memmove(&s->extra[4 + i], &s->extra[5 + i], (6 - i) * sizeof(s->extra[0]));
+                s->extra[10] = piece;
                 break;
             }
         }
     }
 
     // Update the history with the new piece.
-    f->randBufExtra[f->randBufIndex] = piece;
-    f->randBufIndex = (f->randBufIndex + 1) & 3;
+    s->extra[s->index] = piece;
+    s->index = (s->index + 1) & 3;
     return piece;
 }
 
-static void initRandomizer(FSEngine *f)
+void fsRandStateInit(FSRandCtx *ctx, FSRandState *s, int randomizer)
 {
-    switch (f->randomizer) {
+    s->randomizer = randomizer;
+
+    switch (randomizer) {
         case FST_RAND_SIMPLE:
             break;
         case FST_RAND_BAG7:
         case FST_RAND_BAG7_SEAM_CHECK:
         case FST_RAND_BAG6:
-            initBag(f);
+            initBag(ctx, s);
             break;
         case FST_RAND_MULTI_BAG2:
-            initMultiBag(f, 2);
+            initMultiBag(ctx, s, 2);
             break;
         case FST_RAND_MULTI_BAG4:
-            initMultiBag(f, 4);
+            initMultiBag(ctx, s, 4);
             break;
         case FST_RAND_MULTI_BAG9:
-            initMultiBag(f, 9);
+            initMultiBag(ctx, s, 9);
             break;
         case FST_RAND_TGM1:
-            initTGM1(f);
+            initTGM1(s);
             break;
         case FST_RAND_TGM2:
-            initTGM2(f);
+            initTGM2(s);
             break;
         case FST_RAND_TGM3:
-            initTGM3(f);
+            initTGM3(s);
             break;
     }
 }
 
+// Generate `n` pieces with the expression `next`.
+#define FILL(next)                      \
+    do {                                \
+        for (size_t i = 0; i < n; ++i) {\
+            out[i] = (next);            \
+        }                               \
+    } while (0)
+
 ///
-// Generate the next random piece in sequence using the games randomizer.
-//
-// This wil initialize the randomizer if it has yet to be called with the
-// current randomizer type.
+// Generate the next `n` pieces of the sequence.
 //
-// Theoretically we could switch randomizers mid-game with no trouble however
-// this would require extra tweaks for replay management.
+// The randomizer is selected once, so each piece costs only the randomizer
+// itself. Generating a sequence in any number of calls produces the same
+// pieces.
 ///
-FSBlock fsNextRandomPiece(FSEngine *f)
+void fsRandFill(FSRandCtx *ctx, FSRandState *s, FSBlock *out, size_t n)
 {
-    if (f->randomizer != f->lastRandomizer) {
-        f->lastRandomizer = f->randomizer;
-        initRandomizer(f);
-    }
-
-    switch (f->randomizer) {
+    switch (s->randomizer) {
         case FST_RAND_SIMPLE:
-            return fromSimple(f);
+            FILL(fromSimple(ctx));
+            break;
         case FST_RAND_BAG7:
-            return fromBag(f, 7, false);
+            FILL(fromBag(ctx, s, 7, false));
+            break;
         case FST_RAND_TGM1:
-            return fromTGM1or2(f, 4);
+            FILL(fromTGM1or2(ctx, s, 4));
+            break;
         case FST_RAND_TGM2:
-            return fromTGM1or2(f, 6);
+            FILL(fromTGM1or2(ctx, s, 6));
+            break;
         case FST_RAND_TGM3:
-            return fromTGM3(f);
+            FILL(fromTGM3(ctx, s));
+            break;
         case FST_RAND_BAG7_SEAM_CHECK:
-            return fromBag(f, 7, true);
+            FILL(fromBag(ctx, s, 7, true));
+            break;
         case FST_RAND_BAG6:
-            return fromBag(f, 6, false);
+            FILL(fromBag(ctx, s, 6, false));
+            break;
         case FST_RAND_MULTI_BAG2:
-            return fromMultiBag(f, 2);
+            FILL(fromMultiBag(ctx, s, 2));
+            break;
         case FST_RAND_MULTI_BAG4:
-            return fromMultiBag(f, 4);
+            FILL(fromMultiBag(ctx, s, 4));
+            break;
         case FST_RAND_MULTI_BAG9:
-            return fromMultiBag(f, 9);
+            FILL(fromMultiBag(ctx, s, 9));
+            break;
         default:
-            fsLogFatal("Unknown randomizer: %d", f->randomizer);
+            fsLogFatal("Unknown randomizer: %d", s->randomizer);
             abort();
     }
+}
 
-    // unreachable
-    return 0;
+#undef FILL
+
+///
+// Generate the next random piece in sequence using the games randomizer.
+//
+// This wil initialize the randomizer if it has yet to be called with the
+// current randomizer type.
+//
+// Theoretically we could switch randomizers mid-game with no trouble however
+// this would require extra tweaks for replay management.
+///
+FSBlock fsNextRandomPiece(FSEngine *f)
+{
+    FSBlock b;
+
+    if (f->config->randomizer != f->randState.randomizer) {
+        fsRandStateInit(&f->randomContext, &f->randState, f->config->randomizer);
+    }
+
+    fsRandFill(&f->randomContext, &f->randState, &b, 1);
+    return b;
 }
@@ -12,6 +12,7 @@
 #ifndef FS_RAND_H
 #define FS_RAND_H
 
+#include "config.h"
 #include "core.h"
 
 enum RandomizerType {
@@ -38,6 +39,43 @@ struct FSRandCtx {
     u32 a, b, c, d;
 };
 
+// Number of PRNG contexts stepped together by a `FSRandLanes`.
+#define FS_RAND_LANES 8
+
+///
+// A set of random state contexts stored by component.
+//
+// Each lane is an independent `FSRandCtx` which produces exactly the same
+// sequence as the scalar functions would, but all lanes are stepped at once
+// with SIMD instructions where available.
+///
+struct FSRandLanes {
+    u32 a[FS_RAND_LANES];
+    u32 b[FS_RAND_LANES];
+    u32 c[FS_RAND_LANES];
+    u32 d[FS_RAND_LANES];
+};
+
+///
+// Randomizer state.
+//
+// Everything a randomizer carries between pieces apart from the PRNG itself.
+// The meaning of `buf`, `extra` and `index` is specific to each randomizer.
+///
+struct FSRandState {
+    /// The randomizer this state was initialized for.
+    i8 randomizer;
+
+    /// Buffer for calculating next pieces.
+    FSBlock buf[FS_RAND_BUFFER_LEN];
+
+    /// An extra buffer for caching special values across rolls.
+    u32 extra[FS_RAND_BUFFER_EXTRA_LEN];
+
+    /// Index for `buf`.
+    int index;
+};
+
 // Returns a seed which provides sufficient sub-millisecond movement.
 u32 fsGetRoughSeed(void);
 
@@ -47,6 +85,21 @@ u32 fsRandNext(FSRandCtx *ctx);
 // Seed the random context.
 void fsRandSeed(FSRandCtx *ctx, u32 seed);
 
+// Return the next u32 in the PRNG sequence of every lane.
+void fsRandLanesNext(FSRandLanes *ctx, u32 out[FS_RAND_LANES]);
+
+// Seed each lane with the corresponding seed.
+void fsRandLanesSeed(FSRandLanes *ctx, const u32 seed[FS_RAND_LANES]);
+
+// Copy the state of a single lane into a scalar context.
+void fsRandLanesGet(const FSRandLanes *ctx, int lane, FSRandCtx *dst);
+
+// Initialize the state of the specified randomizer.
+void fsRandStateInit(FSRandCtx *ctx, FSRandState *s, int randomizer);
+
+// Generate the next `n` pieces of an initialized randomizer.
+void fsRandFill(FSRandCtx *ctx, FSRandState *s, FSBlock *out, size_t n);
+
 // Retrieve the next random piece in the queue for the specified engine.
 FSBlock fsNextRandomPiece(FSEngine *f);
 
@@ -0,0 +1,163 @@
+///
+// replay.c
+// ========
+//
+// Binary replay encoding. See replay.h for the format.
+///
+
+#include "engine.h"
+#include "replay.h"
+
+static const u8 magic[3] = { 'F', 'S', 'R' };
+
+// Options stored in the header, in order.
+#define HEADER_FIELDS(X) \
+    X(goal)                 \
+    X(fieldWidth)           \
+    X(fieldHeight)          \
+    X(fieldHidden)          \
+    X(initialActionStyle)   \
+    X(dasSpeed)             \
+    X(dasDelay)             \
+    X(msPerTick)            \
+    X(ticksPerDraw)         \
+    X(areDelay)             \
+    X(areCancellable)       \
+    X(lockStyle)            \
+    X(lockDelay)            \
+    X(floorkickLimit)       \
+    X(oneShotSoftDrop)      \
+    X(rotationSystem)       \
+    X(gravity)              \
+    X(softDropGravity)      \
+    X(randomizer)           \
+    X(readyPhaseLength)     \
+    X(goPhaseLength)        \
+    X(infiniteReadyGoHold)  \
+    X(nextPieceCount)
+
+static u32 zigzag(i32 v)
+{
+    return ((u32) v << 1) ^ (u32) -(v < 0);
+}
+
+static i32 unzigzag(u32 v)
+{
+    return (i32) (v >> 1) ^ -(i32) (v & 1);
+}
+
+static i32 putVarint(u8 *dst, u32 v)
+{
+    i32 n = 0;
+
+    while (v >= 0x80) {
+        dst[n++] = (v & 0x7f) | 0x80;
+        v >>= 7;
+    }
+    dst[n++] = v;
+
+    return n;
+}
+
+// Returns the number of bytes read or -1 if the varint is truncated.
+static i32 getVarint(const u8 *src, i32 length, u32 *v)
+{
+    u32 result = 0;
+
+    for (i32 n = 0; n < length && n < 5; ++n) {
+        result |= (u32) (src[n] & 0x7f) << (7 * n);
+        if (!(src[n] & 0x80)) {
+            *v = result;
+            return n + 1;
+        }
+    }
+
+    return -1;
+}
+
+i32 fsReplayEncodeHeader(u8 *dst, u32 seed, const FSEngineConfig *c)
+{
+    i32 n = 0;
+
+    memcpy(dst, magic, sizeof(magic));
+    n += sizeof(magic);
+    n += putVarint(dst + n, FS_REPLAY_FORMAT_VERSION);
+    n += putVarint(dst + n, seed);
+
+#define ENCODE(name) n += putVarint(dst + n, zigzag(c->name));
+    HEADER_FIELDS(ENCODE)
+#undef ENCODE
+
+    return n;
+}
+
+i32 fsReplayEncodeEvent(u8 *dst, const FSReplayEvent *prev, const FSReplayEvent *e)
+{
+    i32 n = 0;
+
+    n += putVarint(dst + n, e->tick - prev->tick);
+    n += putVarint(dst + n, zigzag(e->time));
+    n += putVarint(dst + n, e->keys ^ prev->keys);
+
+    return n;
+}
+
+i32 fsReplayDecodeHeader(const u8 *src, i32 length, u32 *seed, FSEngineConfig *c)
+{
+    i32 n = sizeof(magic);
+    i32 r;
+    u32 v;
+
+    if (length < n || src[0] != magic[0] || src[1] != magic[1] || src[2] != magic[2]) {
+        return -1;
+    }
+
+    if ((r = getVarint(src + n, length - n, &v)) < 0 || v != FS_REPLAY_FORMAT_VERSION) {
+        return -1;
+    }
+    n += r;
+
+    if ((r = getVarint(src + n, length - n, seed)) < 0) {
+        return -1;
+    }
+    n += r;
+
+#define DECODE(name)                                    \
+    if ((r = getVarint(src + n, length - n, &v)) < 0) { \
+        return -1;                                      \
+    }                                                   \
+    n += r;                                             \
+    c->name = unzigzag(v);
+
+    HEADER_FIELDS(DECODE)
+#undef DECODE
+
+    return n;
+}
+
+i32 fsReplayDecodeEvent(const u8 *src, i32 length, const FSReplayEvent *prev,
+                        FSReplayEvent *e)
+{
+    i32 n = 0;
+    i32 r;
+    u32 delta, time, keys;
+
+    if ((r = getVarint(src + n, length - n, &delta)) < 0) {
+        return -1;
+    }
+    n += r;
+    if ((r = getVarint(src + n, length - n, &time)) < 0) {
+        return -1;
+    }
+    n += r;
+    if ((r = getVarint(src + n, length - n, &keys)) < 0) {
+        return -1;
+    }
+    n += r;
+
+    e->tick = prev->tick + delta;
+    e->time = unzigzag(time);
+    e->keys = prev->keys ^ keys;
+
+    return n;
+}
@@ -0,0 +1,58 @@
+///
+// replay.h
+// ========
+//
+// Compact binary encoding of a replay.
+//
+// A replay is a header holding the seed and the options of the game, followed
+// by each key change in order. Every value is a LEB128 varint, with signed
+// values zigzag encoded first. A change is stored as the number of ticks since
+// the previous change, its time within the tick and the keys which changed
+// (the XOR with the previous keys), so a typical change takes 3-4 bytes.
+//
+// The encoding does not depend on how a replay is stored. The functions only
+// read and write caller-provided buffers, so they can be used in any frontend.
+///
+
+#ifndef FS_REPLAY_H
+#define FS_REPLAY_H
+
+#include "core.h"
+
+// Version of the encoding, stored after the magic bytes of the header.
+#define FS_REPLAY_FORMAT_VERSION 1
+
+// Largest encoded size of a header and of a single key change.
+#define FS_REPLAY_HEADER_MAX 128
+#define FS_REPLAY_EVENT_MAX 15
+
+// A key change of a replay.
+struct FSReplayEvent {
+    /// Tick the change applies to.
+    u32 tick;
+
+    /// Time of the change in microseconds from the start of the tick.
+    i32 time;
+
+    /// Virtual keys pressed after the change.
+    u32 keys;
+};
+
+// Write a header for a game with the specified seed and options. Returns the
+// number of bytes written, at most `FS_REPLAY_HEADER_MAX`.
+i32 fsReplayEncodeHeader(u8 *dst, u32 seed, const FSEngineConfig *c);
+
+// Write a key change following `prev`, which is all zero for the first
+// change. Returns the number of bytes written, at most `FS_REPLAY_EVENT_MAX`.
+i32 fsReplayEncodeEvent(u8 *dst, const FSReplayEvent *prev, const FSReplayEvent *e);
+
+// Read a header. Options not stored in a replay are left unchanged. Returns
+// the number of bytes read or -1 if the header is invalid or truncated.
+i32 fsReplayDecodeHeader(const u8 *src, i32 length, u32 *seed, FSEngineConfig *c);
+
+// Read a key change following `prev`. Returns the number of bytes read or -1
+// if the change is truncated.
+i32 fsReplayDecodeEvent(const u8 *src, i32 length, const FSReplayEvent *prev,
+                        FSReplayEvent *e);
+
+#endif // FS_REPLAY_H
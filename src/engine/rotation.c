@@ -474,3 +474,41 @@ static const FSRotationSystem rotDTET = {
 const FSRotationSystem *rotationSystems[FS_NRS] = {
     &rotSimple, &rotSega, &rotSRS, &rotArikaSRS, &rotTGM12, &rotTGM3, &rotDTET
 };
+
+FSPieceMask pieceMasks[FS_NRS][FS_NPT][FS_NPR];
+
+void fsInitPieceMasks(void)
+{
+    static bool initialized = false;
+
+    if (initialized) {
+        return;
+    }
+
+    for (int r = 0; r < FS_NRS; ++r) {
+        for (int p = 0; p < FS_NPT; ++p) {
+            for (int t = 0; t < FS_NPR; ++t) {
+                FSPieceMask *m = &pieceMasks[r][p][t];
+                const int calcTheta = (t + rotationSystems[r]->entryTheta[p]) & 3;
+
+                memset(m->rows, 0, sizeof(m->rows));
+                memset(m->bottom, -1, sizeof(m->bottom));
+                m->minX = m->minY = 3;
+                m->maxX = m->maxY = 0;
+
+                for (int i = 0; i < FS_NBP; ++i) {
+                    const i8x2 b = pieceOffsets[p][calcTheta][i];
+
+                    m->rows[b.y] |= 1 << b.x;
+                    if (b.y > m->bottom[b.x]) { m->bottom[b.x] = b.y; }
+                    if (b.x < m->minX) { m->minX = b.x; }
+                    if (b.x > m->maxX) { m->maxX = b.x; }
+                    if (b.y < m->minY) { m->minY = b.y; }
+                    if (b.y > m->maxY) { m->maxY = b.y; }
+                }
+            }
+        }
+    }
+
+    initialized = true;
+}
@@ -67,11 +67,41 @@ struct FSRotationSystem {
     WallkickTable kickTables[FS_MAX_NO_OF_WALLKICK_TABLES];
 };
 
+///
+// Occupancy mask of a single piece in a specific rotation state.
+//
+// Each entry of `rows` stores the filled columns of one row of the 4x4 piece
+// box, with bit `x` set if column `x` is filled. The bounding box of the
+// filled cells is stored as well so a collision probe only needs to test the
+// rows a piece actually covers.
+///
+typedef struct FSPieceMask {
+    /// Filled columns of each row in the piece box.
+    u8 rows[4];
+
+    /// Lowest filled row of each column in the piece box, -1 if empty.
+    i8 bottom[4];
+
+    /// Inclusive bounding box of the filled cells within the piece box.
+    i8 minX, maxX, minY, maxY;
+} FSPieceMask;
+
 ///
 // The core piece offsets used.
 ///
 extern const i8x2 pieceOffsets[FS_NPT][FS_NPR][FS_NBP];
 
+///
+// Piece masks indexed by rotation system, piece type and rotation state.
+//
+// These are derived from `pieceOffsets` and the entry theta of each rotation
+// system, so the theta used for indexing is the same as that stored in an
+// `FSEngine`.
+//
+// This is only valid after `fsInitPieceMasks` has been called.
+///
+extern FSPieceMask pieceMasks[FS_NRS][FS_NPT][FS_NPR];
+
 ///
 // Rotation Systems are defined statically. We only store an index to the
 // currently used table in 'FSEngine'.
@@ -83,4 +113,12 @@ extern const FSRotationSystem *rotationSystems[FS_NRS];
 ///
 extern const WallkickTable emptyWallkickTable;
 
+///
+// Generate the `pieceMasks` table.
+//
+// This is called by `fsGameInit` and only performs work on the first call. It
+// must be called at least once before engines are shared across threads.
+///
+void fsInitPieceMasks(void);
+
 #endif // FS_ROTATION_H
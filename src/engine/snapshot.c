@@ -0,0 +1,172 @@
+///
+// snapshot.c
+// ==========
+//
+// Snapshot and restore of the mutable engine state.
+//
+// Every value is copied individually so option values in the target engine
+// are never touched. `lastInput` is not stored since it is overwritten at the
+// start of every tick. Any new @I or @E value added to `FSEngine` needs to be
+// added to `FSEngineSnapshot` and the list below as well.
+///
+
+#include "engine.h"
+#include "replay.h"
+#include "snapshot.h"
+
+// Apply `X` to each snapshotted value.
+#define SNAPSHOT_VALUES(X)  \
+    X(rowMask)              \
+    X(randomContext)        \
+    X(randState)            \
+    X(se)                   \
+    X(pieceRotateCount)     \
+    X(pieceMovePressCount)  \
+    X(finesse)              \
+    X(actualY)              \
+    X(totalKeysPressed)     \
+    X(areTimer)             \
+    X(actualTime)           \
+    X(genericCounter)       \
+    X(totalTicks)           \
+    X(totalTicksRaw)        \
+    X(lockTimer)            \
+    X(linesCleared)         \
+    X(blocksPlaced)         \
+    X(nextHead)             \
+    X(b)                    \
+    X(rowIndex)             \
+    X(rowFill)              \
+    X(columnHeight)         \
+    X(nextPiece)            \
+    X(piece)                \
+    X(x)                    \
+    X(y)                    \
+    X(hardDropY)            \
+    X(theta)                \
+    X(irsAmount)            \
+    X(ihsFlag)              \
+    X(floorkickCount)       \
+    X(state)                \
+    X(lastState)            \
+    X(holdAvailable)        \
+    X(holdPiece)            \
+    X(replay)
+
+void fsEngineSnapshot(const FSEngine *f, const FSControl *c, FSEngineSnapshot *s)
+{
+    // Clear padding so identical states produce identical blobs.
+    memset(s, 0, sizeof(*s));
+
+#define X(name) memcpy(&s->name, &f->name, sizeof(s->name));
+    SNAPSHOT_VALUES(X)
+#undef X
+
+    s->control = *c;
+}
+
+void fsEngineRestore(FSEngine *f, FSControl *c, const FSEngineSnapshot *s)
+{
+#define X(name) memcpy(&f->name, &s->name, sizeof(f->name));
+    SNAPSHOT_VALUES(X)
+#undef X
+
+    *c = s->control;
+}
+
+void fsSnapshotRingInit(FSSnapshotRing *r, i32 interval, const FSEngine *f,
+                        const FSControl *c)
+{
+    assert(interval > 0);
+
+    r->config = *f->config;
+    r->seed = f->seed;
+    r->interval = interval;
+    r->head = 0;
+    r->count = 0;
+    fsEngineSnapshot(f, c, &r->first);
+}
+
+///
+// Return the entry which was recorded `age` snapshots ago.
+///
+static const FSEngineSnapshot* ringEntry(const FSSnapshotRing *r, i32 age)
+{
+    const i32 i = (r->head - 1 - age + FS_SNAPSHOT_RING_LEN) % FS_SNAPSHOT_RING_LEN;
+    return &r->entries[i];
+}
+
+void fsSnapshotRingUpdate(FSSnapshotRing *r, const FSEngine *f, const FSControl *c)
+{
+    if (f->totalTicksRaw % r->interval != 0) {
+        return;
+    }
+
+    // Replayed ticks after a backwards seek have been recorded already.
+    if (r->count && ringEntry(r, 0)->totalTicksRaw >= f->totalTicksRaw) {
+        return;
+    }
+
+    fsEngineSnapshot(f, c, &r->entries[r->head]);
+    r->head = (r->head + 1) % FS_SNAPSHOT_RING_LEN;
+    if (r->count < FS_SNAPSHOT_RING_LEN) {
+        r->count += 1;
+    }
+}
+
+const FSEngineSnapshot* fsSnapshotRingFind(const FSSnapshotRing *r, i32 tick)
+{
+    // Entries are recorded in increasing tick order so walk back from the
+    // newest.
+    for (i32 age = 0; age < r->count; ++age) {
+        const FSEngineSnapshot *s = ringEntry(r, age);
+        if (s->totalTicksRaw <= tick) {
+            return s;
+        }
+    }
+
+    return &r->first;
+}
+
+i32 fsSnapshotRingSeek(const FSSnapshotRing *r, FSEngine *f, FSControl *c,
+                       const FSReplayEvent *events, i32 count, i32 tick)
+{
+    f->config = &r->config;
+    f->seed = r->seed;
+    fsEngineRestore(f, c, fsSnapshotRingFind(r, tick));
+
+    // Find the first change at or after the restored tick.
+    i32 lo = 0;
+    i32 hi = count;
+    while (lo < hi) {
+        const i32 mid = lo + (hi - lo) / 2;
+        if (events[mid].tick < (u32) f->totalTicksRaw) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    FSKeyEvent tickEvents[FS_MAX_KEY_EVENTS];
+    i32 next = lo;
+
+    while (f->totalTicksRaw < tick && f->state != FSS_GAMEOVER) {
+        const u32 current = f->totalTicksRaw;
+        i32 n = 0;
+
+        for (; next < count && events[next].tick == current; ++next) {
+            // Keep the final state if there are more changes than can be
+            // applied, as playback does.
+            if (n == FS_MAX_KEY_EVENTS) {
+                n -= 1;
+            }
+            tickEvents[n].time = events[next].time;
+            tickEvents[n].keys = events[next].keys;
+            n += 1;
+        }
+
+        fsGameTickEvents(f, c, tickEvents, n, 0);
+    }
+
+    return f->totalTicksRaw;
+}
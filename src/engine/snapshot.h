@@ -0,0 +1,158 @@
+///
+// snapshot.h
+// ==========
+//
+// Compact snapshots of the mutable state of an `FSEngine`.
+//
+// A snapshot stores only the internal (@I) and external (@E) values of an
+// engine along with its control state. Options (@O) are never stored since
+// they are fixed for the duration of a game, so a snapshot can only be
+// restored into an engine which was configured with the same options. A ring
+// stores the options and seed of its game once instead.
+//
+// A snapshot ring records a snapshot every N ticks. A replay can then seek to
+// an arbitrary tick by restoring the nearest earlier snapshot and simulating
+// forward from there, instead of replaying from the first tick.
+///
+
+#ifndef FS_SNAPSHOT_H
+#define FS_SNAPSHOT_H
+
+#include "config.h"
+#include "control.h"
+#include "core.h"
+#include "engine.h"
+#include "rand.h"
+
+///
+// The mutable state of a single game at a specific tick.
+//
+// See `FSEngine` for the documentation of each value. Values are ordered by
+// decreasing alignment so no padding is needed between them.
+///
+struct FSEngineSnapshot {
+    FSRowMask rowMask[FS_MAX_HEIGHT];
+    FSRandCtx randomContext;
+    FSRandState randState;
+    u32 se;
+    i32 pieceRotateCount;
+    i32 pieceMovePressCount;
+    i32 finesse;
+    int32_t actualY;
+    i32 totalKeysPressed;
+    i32 areTimer;
+    i32 actualTime;
+    i32 genericCounter;
+    i32 totalTicks;
+    i32 totalTicksRaw;
+    i32 lockTimer;
+    i32 linesCleared;
+    i32 blocksPlaced;
+
+    /// Control state used to convert keys for this engine.
+    FSControl control;
+
+    i16 nextHead;
+    FSBlock b[FS_MAX_HEIGHT][FS_MAX_WIDTH];
+    u8 rowIndex[FS_MAX_HEIGHT];
+    i8 rowFill[FS_MAX_HEIGHT];
+    i8 columnHeight[FS_MAX_WIDTH];
+    FSBlock nextPiece[FS_MAX_PREVIEW_COUNT];
+    FSBlock piece;
+    i8 x;
+    i8 y;
+    i8 hardDropY;
+    i8 theta;
+    i8 irsAmount;
+    bool ihsFlag;
+    i8 floorkickCount;
+    i8 state;
+    i8 lastState;
+    bool holdAvailable;
+    FSBlock holdPiece;
+    bool replay;
+};
+
+///
+// A ring of snapshots taken at a fixed tick interval.
+//
+// The snapshot of the first tick is always retained so any tick in the game
+// can be reached, even once older ring entries have been overwritten. The
+// seed and options are the same for every snapshot of a game so are only
+// stored once.
+///
+struct FSSnapshotRing {
+    /// Options the game was played with.
+    FSEngineConfig config;
+
+    /// Seed the game was started with.
+    u32 seed;
+
+    /// Snapshot taken before the first tick.
+    FSEngineSnapshot first;
+
+    /// Most recent snapshots in order of recording.
+    FSEngineSnapshot entries[FS_SNAPSHOT_RING_LEN];
+
+    /// Number of ticks between each recorded snapshot.
+    i32 interval;
+
+    /// Index of the next entry to write.
+    i32 head;
+
+    /// Number of valid entries.
+    i32 count;
+};
+
+///
+// Store the mutable state of the engine and control state.
+///
+void fsEngineSnapshot(const FSEngine *f, const FSControl *c, FSEngineSnapshot *s);
+
+///
+// Restore a previously taken snapshot.
+//
+// `f` must use the same options as the engine the snapshot was taken from.
+///
+void fsEngineRestore(FSEngine *f, FSControl *c, const FSEngineSnapshot *s);
+
+///
+// Clear a snapshot ring and record the initial state of a game.
+//
+// This should be called once the engine has been reset and before the first
+// tick is performed.
+//
+//  * i32 interval
+//      Number of ticks between each snapshot.
+///
+void fsSnapshotRingInit(FSSnapshotRing *r, i32 interval, const FSEngine *f,
+                        const FSControl *c);
+
+///
+// Record a snapshot if the engine is at a multiple of the ring interval.
+//
+// This should be called after every tick. Snapshots at or before an existing
+// entry are ignored, so this is safe to call after seeking backwards.
+///
+void fsSnapshotRingUpdate(FSSnapshotRing *r, const FSEngine *f, const FSControl *c);
+
+///
+// Return the latest snapshot taken at or before the specified raw tick.
+///
+const FSEngineSnapshot* fsSnapshotRingFind(const FSSnapshotRing *r, i32 tick);
+
+///
+// Seek an engine to the specified raw tick.
+//
+// The engine is set to the seed and options of the ring, so it must not be
+// used after the ring is discarded. The nearest earlier snapshot is restored
+// and the game is simulated forward with `fsGameTickEvents` using `events`,
+// the key changes of the game in increasing tick order as stored in a replay.
+//
+// Returns the raw tick that was reached. This is less than `tick` if the game
+// finished first.
+///
+i32 fsSnapshotRingSeek(const FSSnapshotRing *r, FSEngine *f, FSControl *c,
+                       const FSReplayEvent *events, i32 count, i32 tick);
+
+#endif // FS_SNAPSHOT_H
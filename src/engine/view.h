@@ -21,6 +21,9 @@ struct FSView {
     /// Current game instance.
     FSEngine *game;
 
+    /// Options used by the game instance.
+    FSEngineConfig *config;
+
     /// Current input state.
     FSControl *control;
 
@@ -32,6 +35,12 @@ struct FSView {
 
     /// Filename of the replay to load
     char *replayName;
+
+    /// Input latency measurements, or NULL if not measuring.
+    FSLatency *latency;
+
+    /// CSV file latencies are appended to at the end of each game, or NULL.
+    const char *latencyFile;
 };
 
 #endif
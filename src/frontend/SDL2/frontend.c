@@ -120,10 +120,10 @@ void fsiFini(FSFrontend *v)
     SDL_Quit();
 }
 
-// We used fixed colours for the moment
-const int CRED[7]   = {  5, 238, 249,   7,  93, 250, 237};
-const int CGREEN[7] = {186,  23, 187,  94, 224, 105, 225};
-const int CBLUE[7]  = {221, 234,   0, 240,  31,   0,   0};
+// We used fixed colours for the moment. The final entry is for garbage.
+const int CRED[FS_NPT + 1]   = {  5, 238, 249,   7,  93, 250, 237,  80};
+const int CGREEN[FS_NPT + 1] = {186,  23, 187,  94, 224, 105, 225,  80};
+const int CBLUE[FS_NPT + 1]  = {221, 234,   0, 240,  31,   0,   0,  80};
 
 // Defines how we work out a color pattern for a specific block id.
 #define BLOCK_RGBA_TRIPLE(id) CRED[(id)], CGREEN[(id)], CBLUE[(id)], 255
@@ -131,7 +131,7 @@ const int CBLUE[7]  = {221, 234,   0, 240,  31,   0,   0};
 i32 fsiGetTime(FSFrontend *v)
 {
     (void) v;
-    return SDL_GetTicks() * 1000;
+    return (i32) (SDL_GetTicks() * 1000);
 }
 
 void fsiSleep(FSFrontend *v, i32 time)
@@ -278,7 +278,7 @@ void drawDebug(FSFrontend *v)
     const int elapsedTime = fsiGetTime(v);
 
     // Should only look at a window here  but oh well
-    const float renderFPS = (float) elapsedTime / (1000 * f->totalTicks / f->ticksPerDraw);
+    const float renderFPS = (float) elapsedTime / (1000 * f->totalTicks / f->config->ticksPerDraw);
     const float logicFPS = (float) elapsedTime / (1000 * f->totalTicks);
 
     const int lineSkipY = FC_GetLineHeight(v->font);
@@ -313,7 +313,7 @@ void drawDebug(FSFrontend *v)
     snprintf(writeBuffer, writeBufferSize, "Field:");
     renderString(v, writeBuffer, ux, uy + c++ * lineSkipY);
 
-    snprintf(writeBuffer, writeBufferSize, "    gravity: %.3f", (float) f->gravity / 1000000);
+    snprintf(writeBuffer, writeBufferSize, "    gravity: %.3f", (float) f->config->gravity / 1000000);
     renderString(v, writeBuffer, ux, uy + c++ * lineSkipY);
 
     snprintf(writeBuffer, writeBufferSize, "Input:");
@@ -383,7 +383,7 @@ static void drawPieceAndShadow(FSFrontend *v)
     }
 
     i8x2 blocks[FS_NBP];
-    fsGetBlocks(f, blocks, pid, f->x, f->hardDropY - f->fieldHidden, f->theta);
+    fsGetBlocks(f, blocks, pid, f->x, f->hardDropY - f->config->fieldHidden, f->theta);
 
     for (int i = 0; i < FS_NBP; ++i) {
         block.x = FIELD_X + blocks[i].x * BLOCK_SL;
@@ -403,7 +403,7 @@ static void drawPieceAndShadow(FSFrontend *v)
         SDL_RenderFillRect(v->renderer, &block);
     }
 
-    fsGetBlocks(f, blocks, pid, f->x, f->y - f->fieldHidden, f->theta);
+    fsGetBlocks(f, blocks, pid, f->x, f->y - f->config->fieldHidden, f->theta);
 
     for (int i = 0; i < FS_NBP; ++i) {
         block.x = FIELD_X + blocks[i].x * BLOCK_SL;
@@ -451,11 +451,16 @@ void drawField(FSFrontend *v)
         .h = BLOCK_SL + 1
     };
 
-    for (int y = f->fieldHidden; y < f->fieldHeight; ++y){
-        block.y = FIELD_Y + (y - f->fieldHidden) * BLOCK_SL;
-        for (int x = 0; x < f->fieldWidth; ++x) {
+    for (int y = f->config->fieldHidden; y < f->config->fieldHeight; ++y){
+        block.y = FIELD_Y + (y - f->config->fieldHidden) * BLOCK_SL;
+        for (int x = 0; x < f->config->fieldWidth; ++x) {
             block.x = FIELD_X + x * BLOCK_SL;
-            if (f->b[y][x] > 0) {
+            const FSBlock b = fsGetFieldBlock(f, x, y);
+            if (b == FS_GARBAGE_BLOCK) {
+                SDL_SetRenderDrawColor(v->renderer, BLOCK_RGBA_TRIPLE(fsFieldPieceBlock(b)));
+                SDL_RenderFillRect(v->renderer, &block);
+            }
+            else if (b > 0) {
                 // Grey colour
                 SDL_SetRenderDrawColor(v->renderer, 140, 140, 140, 255);
                 SDL_RenderFillRect(v->renderer, &block);
@@ -485,14 +490,14 @@ static void drawPreviewSection(FSFrontend *v)
     };
 
     const FSEngine *f = v->view->game;
-    const int previewCount = f->nextPieceCount > FS_MAX_PREVIEW_COUNT
-                                ? FS_MAX_PREVIEW_COUNT
-                                : f->nextPieceCount;
+    const int previewCount = f->config->nextPieceCount > FS_MAX_PREVIEW_DRAWN
+                                ? FS_MAX_PREVIEW_DRAWN
+                                : f->config->nextPieceCount;
 
     // Print 4 preview pieces max for now (where do we render if higher?)
     for (int i = 0; i < previewCount; ++i) {
         i8x2 blocks[FS_NBP];
-        const FSBlock pid = f->nextPiece[i];
+        const FSBlock pid = fsGetNextPiece(f, i);
         fsGetBlocks(f, blocks, pid, 0, 0, 0);
 
         // Set field to grey currently
@@ -506,10 +511,10 @@ static void drawPreviewSection(FSFrontend *v)
             // These offsets are only valid if the entryTheta is standard.
             // Sega entryTheta's have incorrect spacing still, but we'll
             // consider this okay since it is less used.
-            if (f->nextPiece[i] == FS_I) {
+            if (pid == FS_I) {
                 block.y -= BLOCK_SL / 2;
             }
-            else if (f->nextPiece[i] != FS_O) {
+            else if (pid != FS_O) {
                 block.x += BLOCK_SL / 2;
             }
 
@@ -526,7 +531,7 @@ static void drawInfoSection(FSFrontend *v)
     const int writeBufferSize = 64;
     char writeBuffer[writeBufferSize];
 
-    int remaining = f->goal - f->linesCleared;
+    int remaining = f->config->goal - f->linesCleared;
     if (remaining < 0) {
         remaining = 0;
     }
@@ -553,7 +558,7 @@ static void drawInfoSection(FSFrontend *v)
     snprintf(writeBuffer, writeBufferSize, "Time");
     renderString(v, writeBuffer, INFOS_X, INFOS_Y + c++ * lineSkipY);
 
-    const int msElapsed = f->msPerTick * f->totalTicks;
+    const int msElapsed = f->config->msPerTick * f->totalTicks;
     snprintf(writeBuffer, writeBufferSize, "%.3f", (float) msElapsed / 1000);
     renderString(v, writeBuffer, INFOS_X, INFOS_Y + c++ * lineSkipY);
 
@@ -45,8 +45,8 @@
 // Field offsets
 #define FIELD_X (v->width * 0.13125)
 #define FIELD_Y (v->height * 0.15)
-#define FIELD_W (v->view->game->fieldWidth * BLOCK_SL)
-#define FIELD_H ((v->view->game->fieldHeight - v->view->game->fieldHidden) * BLOCK_SL)
+#define FIELD_W (v->view->game->config->fieldWidth * BLOCK_SL)
+#define FIELD_H ((v->view->game->config->fieldHeight - v->view->game->config->fieldHidden) * BLOCK_SL)
 
 // Hold offsets
 #define HOLDP_X (FIELD_X - (4.5f * BLOCK_SL))
@@ -29,25 +29,39 @@ static void fsLoadDefaultKeys(FSFrontend *v)
 #undef ADD_KEY
 }
 
-static void updateGameLogic(FSFrontend *v, FSView *g)
+static void updateGameLogic(FSFrontend *v, FSView *g, u32 keystate, i32 readTime)
 {
     FSEngine *f = g->game;
     FSControl *ctl = g->control;
-    FSInput in = {0, 0, 0, 0, 0, 0};
-
-    // We still want to handle quit and restart in a replay
-    u32 keystate = fsiReadKeys(v);
+    FSKeyEvent events[FS_MAX_KEY_EVENTS + 1];
+    i32 count;
 
     if (!g->replayPlayback) {
-        daoInsertReplayInput(g->dao, f->totalTicksRaw, keystate);
+        // Key state is only sampled once per tick, so changes apply at the
+        // start of it.
+        count = 1;
+        events[0].time = 0;
+        events[0].keys = keystate;
+        daoInsertReplayInput(g->dao, f->totalTicksRaw, 0, keystate);
+
+        // Keys are polled, so a change is timed from the poll which saw it.
+        if (g->latency && keystate != ctl->lastKeys) {
+            fsLatencyConsume(g->latency, readTime, fsiGetTime(v));
+        }
     }
     else {
+        // We still want to handle quit and restart in a replay
+        count = daoGetReplayEvents(g->dao, f->totalTicksRaw, events, FS_MAX_KEY_EVENTS);
+
         keystate &= FST_VK_FLAG_RESTART | FST_VK_FLAG_QUIT;
-        keystate |= daoGetReplayInput(g->dao, f->totalTicksRaw);
+        if (keystate) {
+            events[count].time = count ? events[count - 1].time : 0;
+            events[count].keys = (count ? events[count - 1].keys : ctl->lastKeys) | keystate;
+            count += 1;
+        }
     }
 
-    fsVirtualKeysToInput(&in, keystate, f, ctl);
-    fsGameTick(f, &in);
+    fsGameTickEvents(f, ctl, events, count, 0);
 }
 
 static void drawStateStrings(FSFrontend *v, FSView *g)
@@ -63,72 +77,110 @@ static void drawStateStrings(FSFrontend *v, FSView *g)
             break;
     }
 }
-static void updateGameView(FSFrontend *v, FSView *g)
+static void updateGameView(FSFrontend *v, FSView *g, u32 se)
 {
     fsiDraw(v);
     drawStateStrings(v, g);
-    fsiPlaySe(v, g->game->se);
+    fsiPlaySe(v, se);
+}
+
+static bool isGameFinished(const FSEngine *f)
+{
+    return f->state == FSS_GAMEOVER ||
+           f->state == FSS_RESTART ||
+           f->state == FSS_QUIT;
 }
 
 static void playGameLoop(FSFrontend *v, FSView *g)
 {
     FSEngine *f = g->game;
-    i32 tickRate = f->msPerTick * 1000;
-    i32 gameStart = fsiGetTime(v);
-    i32 lastTime = fsiGetTime(v);
-    i32 lag = 0;
-
-    i32 avgFrame = 0;
-
-    // The game loop here uses a fixed timestep with lag reduction. The render
-    // phase is synced and occurs every `ticksPerDraw` frames.
+    const i32 tickRate = f->config->msPerTick * 1000;
+    const i32 drawRate = f->config->drawRate ? 1000000 / f->config->drawRate : 0;
+    const i32 gameStart = fsiGetTime(v);
+    i32 nextTick = gameStart;
+    i32 nextDraw = gameStart;
+    u32 se = 0;
+
+    i32 avgTick = 0;
+    i32 tickCount = 0;
+
+    // The game loop here uses a fixed timestep. Ticks are scheduled every
+    // `tickRate` us from the start of the game and any which are due are run
+    // back-to-back, so game time never drifts from real time.
     //
-    // NOTE: This loop does not account for running too slow. We always assume
-    // we can perform a `logic` -> `render` cycle within `tickRate`.
+    // Drawing occurs every `ticksPerDraw` ticks, or if `drawRate` is set, at
+    // that rate independent of the ticks. Sound effects raised by ticks
+    // between draws are played at the next draw.
     while (1) {
-        i32 startTime = fsiGetTime(v);
-        i32 elapsed = startTime - lastTime;
-        lastTime = startTime;
+        fsiPreFrameHook(v);
 
-        // Lag can potentially be negative and would result in a slightly
-        // longer frame being processed. This seems ok in practice, but we
-        // could probably enforce this as non-negative if we tried.
-        lag += (elapsed - tickRate);
+        const i32 startTime = fsiGetTime(v);
+        const u32 keystate = fsiReadKeys(v);
+        bool draw = false;
+        i32 ticks = 0;
 
-        fsiPreFrameHook(v);
-        updateGameLogic(v, g);
+        while (fsTimeDiff(startTime, nextTick) >= 0 && !isGameFinished(f)) {
+            updateGameLogic(v, g, keystate, startTime);
+            nextTick = fsTimeAdd(nextTick, tickRate);
+            ticks += 1;
+            se |= f->se;
+
+            if (!drawRate && f->totalTicks % f->config->ticksPerDraw == 0) {
+                draw = true;
+            }
+        }
+
+        const i32 logicTime = fsiGetTime(v);
+        if (ticks) {
+            tickCount += ticks;
+            avgTick = avgTick + (fsTimeDiff(logicTime, startTime) / ticks - avgTick) * ticks / tickCount;
+        }
+        if (ticks > 1) {
+            fsLogDebug("Tick %d ran %d ticks late", f->totalTicks, ticks - 1);
+        }
+
+        if (drawRate && fsTimeDiff(startTime, nextDraw) >= 0) {
+            draw = true;
+
+            // Skip any draws we were too slow to make.
+            nextDraw = fsTimeAdd(nextDraw, drawRate);
+            if (fsTimeDiff(startTime, nextDraw) >= 0) {
+                nextDraw = fsTimeAdd(startTime, drawRate);
+            }
+        }
 
-        const bool lastFrame = f->state == FSS_GAMEOVER ||
-                               f->state == FSS_RESTART ||
-                               f->state == FSS_QUIT;
+        const bool lastFrame = isGameFinished(f);
 
         // We always want to draw the final frame, even if we were in between
         // ticks.
-        if (f->totalTicks % f->ticksPerDraw == 0 || lastFrame) {
-            updateGameView(v, g);
+        if (draw || lastFrame) {
+            updateGameView(v, g, se);
             fsiPostFrameHook(v);
             fsiBlit(v);
+            se = 0;
+
+            if (g->latency) {
+                fsLatencyBlit(g->latency, fsiGetTime(v));
+            }
         }
 
-        i32 currentTime = fsiGetTime(v);
-        f->actualTime = currentTime - gameStart;
-        avgFrame = avgFrame + ((currentTime - startTime) - avgFrame) / f->totalTicksRaw;
+        const i32 currentTime = fsiGetTime(v);
+        f->actualTime = fsTimeDiff(currentTime, gameStart);
 
         // Break early if we know we are finished to save `tickRate` us of lag.
         if (lastFrame) {
             break;
         }
 
-        const i32 tickEnd = startTime + tickRate;
-
-        if (tickEnd < currentTime) {
-            fsLogDebug("Tick %ld took %ld but tickrate is only %ld",
-                        f->totalTicks, currentTime - startTime, tickRate);
+        // Sleep until the next tick or draw is due.
+        i32 wake = nextTick;
+        if (drawRate && fsTimeDiff(nextDraw, wake) < 0) {
+            wake = nextDraw;
         }
 
-        // If frame has taken too long to render then this could be negative.
-        // Avoid the underflow (resulting in a long sleep).
-        const i32 value = tickEnd - lag - currentTime;
+        // If we are running behind this could be negative. Avoid the
+        // underflow (resulting in a long sleep).
+        const i32 value = fsTimeDiff(wake, currentTime);
         fsiSleep(v, value > 0 ? value : 0);
     }
 
@@ -136,13 +188,21 @@ static void playGameLoop(FSFrontend *v, FSView *g)
     // Cross-reference the in-game time (as calculated from the number of
     // elapsed ticks) to a reference clock to ensure it runs accurately.
     const double actualElapsed = (double) f->actualTime / 1000000;
-    const double ingameElapsed = (double) (f->totalTicksRaw * f->msPerTick) / 1000;
+    const double ingameElapsed = (double) (f->totalTicksRaw * f->config->msPerTick) / 1000;
 
-    fsLogDebug("Average frame time: %d", avgFrame);
+    fsLogDebug("Average tick time: %d", avgTick);
     fsLogDebug("Actual time elapsed: %lf", actualElapsed);
     fsLogDebug("Ingame time elapsed: %lf", ingameElapsed);
     fsLogDebug("Maximum Difference: %lf", actualElapsed - ingameElapsed);
 #endif
+
+    if (g->latency) {
+        fsLatencyLog(g->latency);
+        if (g->latencyFile) {
+            fsLatencyWriteCsv(g->latency, f, g->latencyFile);
+        }
+        fsLatencyInit(g->latency);
+    }
 }
 
 // As close to a menu as we'll get.
@@ -252,14 +312,19 @@ end:;
 int main(int argc, char **argv)
 {
     FSEngine game;
+    FSEngineConfig config;
     FSControl control;
     FSDao dao;
-    FSView gView = { .game = &game, .control = &control, .dao= &dao,
+    FSView gView = { .game = &game, .config = &config, .control = &control, .dao= &dao,
                      .replayName = NULL, .replayPlayback = false };
     FSFrontend pView = { .view = &gView };
 
     FSOptions o;
 
+#ifndef FS_DISABLE_LATENCY
+    static FSLatency latency;
+#endif
+
 #ifdef FS_USE_TERMINAL
     fsSetLogFile(FS_LOG_FILENAME);
 #else
@@ -273,7 +338,8 @@ int main(int argc, char **argv)
     }
 
     fsiPreInit(&pView);
-    fsGameInit(&game);
+    fsConfigInit(&config);
+    fsGameInit(&game, &config);
     daoInit(&dao);
     fsLoadDefaultKeys(&pView);
 
@@ -285,11 +351,20 @@ int main(int argc, char **argv)
         // Attempt to load a replay file here before we initialize the
         // graphics itself to avoid a flicker on invalid replays.
         gView.replayPlayback = true;
-        daoLoadReplay(&dao, &game, atoi(o.replay));
+        daoLoadReplay(&dao, &game, &config, atoi(o.replay));
+    }
+
+#ifndef FS_DISABLE_LATENCY
+    if (o.latency && !gView.replayPlayback) {
+        fsLatencyInit(&latency);
+        gView.latency = &latency;
+        gView.latencyFile = o.latencyFile;
     }
+#endif
 
     fsiInit(&pView);
     gameLoop(&pView, &gView);
+    daoDeinit(&dao);
 
     fsiFini(&pView);
 
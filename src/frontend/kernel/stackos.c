@@ -15,6 +15,9 @@ const int field_y_offset = 1;
 // Main tetris engine.
 FSEngine engine;
 
+// Options shared by the tetris engine.
+FSEngineConfig config;
+
 // Control options for the tetris engine.
 FSControl control;
 
@@ -63,15 +66,15 @@ static void draw_field(void)
 {
     tty_set_cursor(0, field_y_offset);
 
-    for (int y = engine.fieldHidden; y < engine.fieldHeight; ++y) {
+    for (int y = engine.config->fieldHidden; y < engine.config->fieldHeight; ++y) {
         for (int i = 0; i < field_x_offset - 1; ++i) {
             ttyb_putc(' ');
         }
         ttyb_putc('|');
 
-        for (int x = 0; x < engine.fieldWidth; ++x) {
+        for (int x = 0; x < engine.config->fieldWidth; ++x) {
             int tty_color;
-            if (engine.b[y][x]) {
+            if (fsGetFieldBlock(&engine, x, y)) {
                 tty_color = vga_entry_color(VGA_COLOR_BLACK, VGA_COLOR_LIGHT_GREY);
             }
             else {
@@ -91,7 +94,7 @@ static void draw_field(void)
         ttyb_putc(' ');
     }
     ttyb_putc('-');
-    for (int x = 0; x < engine.fieldWidth; ++x) {
+    for (int x = 0; x < engine.config->fieldWidth; ++x) {
         ttyb_puts("--");
     }
     ttyb_puts("-\n");
@@ -112,7 +115,7 @@ static void draw_block(void)
 
     // Draw block ghost
     fsGetBlocks(&engine, blocks, engine.piece, engine.x,
-                engine.hardDropY - engine.fieldHidden, engine.theta);
+                engine.hardDropY - engine.config->fieldHidden, engine.theta);
     for (int i = 0; i < FS_NBP; ++i) {
         if (blocks[i].y < 0) {
             continue;
@@ -130,7 +133,7 @@ static void draw_block(void)
 
     // Draw block
     fsGetBlocks(&engine, blocks, engine.piece, engine.x,
-                engine.y - engine.fieldHidden, engine.theta);
+                engine.y - engine.config->fieldHidden, engine.theta);
     for (int i = 0; i < FS_NBP; ++i) {
         if (blocks[i].y < 0) {
             continue;
@@ -170,14 +173,14 @@ static void draw_preview(void)
 {
     i8x2 blocks[4];
 
-    const int preview_count = engine.nextPieceCount > FS_MAX_PREVIEW_COUNT ?
-                                FS_MAX_PREVIEW_COUNT : engine.nextPieceCount;
+    const int preview_count = engine.config->nextPieceCount > FS_MAX_PREVIEW_DRAWN ?
+                                FS_MAX_PREVIEW_DRAWN : engine.config->nextPieceCount;
     for (int i = 0; i < preview_count; ++i) {
-        const int tty_color = vga_entry_color(VGA_COLOR_BLACK,
-                                              colormap[engine.nextPiece[i]]);
+        const FSBlock piece = fsGetNextPiece(&engine, i);
+        const int tty_color = vga_entry_color(VGA_COLOR_BLACK, colormap[piece]);
         tty_set_color(tty_color);
 
-        fsGetBlocks(&engine, blocks, engine.nextPiece[i], 0, 0, 0);
+        fsGetBlocks(&engine, blocks, piece, 0, 0, 0);
         const int x_offset = (engine.holdPiece == FS_I ||
                                 engine.holdPiece == FS_O ? 0 : 1);
         for (int j = 0; j < FS_NBP; ++j) {
@@ -199,7 +202,7 @@ static void draw_statistics(void)
     const int tty_color = vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_BLACK);
     tty_set_color(tty_color);
 
-    const float s_elapsed = (float) engine.msPerTick * engine.totalTicks / 1000;
+    const float s_elapsed = (float) engine.config->msPerTick * engine.totalTicks / 1000;
     tty_set_cursor(x, y++);
     ttyb_printf("TIME");
     tty_set_cursor(x, y++);
@@ -239,9 +242,9 @@ static void draw_statistics(void)
 
 static void draw_target(void)
 {
-    const int remaining = engine.goal - engine.linesCleared > 0 ?
-                            engine.goal - engine.linesCleared : 0;
-    tty_set_cursor(field_x_offset + 9, field_y_offset + engine.fieldHeight);
+    const int remaining = engine.config->goal - engine.linesCleared > 0 ?
+                            engine.config->goal - engine.linesCleared : 0;
+    tty_set_cursor(field_x_offset + 9, field_y_offset + engine.config->fieldHeight);
     ttyb_printf("%d", remaining);
 }
 
@@ -285,7 +288,7 @@ void draw(void)
 
 void update(void)
 {
-    FSInput input = {0, 0, 0, 0, 0, 0};
+    FSInput input = {0, 0, 0, 0, 0, 0, 0};
     uint32_t keystate = read_keys();
 
     fsVirtualKeysToInput(&input, keystate, &engine, &control);
@@ -307,7 +310,8 @@ void kernel_main(void)
 restart:
     tty_clear();
     engine.seed = timer_seed();
-    fsGameInit(&engine);
+    fsConfigInit(&config);
+    fsGameInit(&engine, &config);
 
     while (1) {
         // Wait until restart/quit event then restart game.
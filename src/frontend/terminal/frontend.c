@@ -111,7 +111,7 @@ static int openInputDevice(void)
 
                 fsLogInfo("determined input device to be %s", deviceName);
                 snprintf(buf, sizeof(buf), DEV_INPUT_PREFIX "/" "%s", deviceName);
-                const int fd = open(buf, O_RDONLY);
+                const int fd = open(buf, O_RDONLY | O_NONBLOCK);
 
                 if (fd == -1) {
                     if (errno == EACCES) {
@@ -155,6 +155,8 @@ static int openInputDevice(void)
     exit(1);
 }
 
+static void syncKeys(FSFrontend *v);
+
 void getTerminalDimensions(FSFrontend *v)
 {
     struct winsize win;
@@ -173,6 +175,19 @@ void fsiInit(FSFrontend *v)
 {
     v->inputFd = openInputDevice();
 
+    // Event timestamps are wall-clock by default. Ask for the clock used by
+    // `fsiGetTime` so events can be compared against tick times.
+    int clock = CLOCK_MONOTONIC;
+    v->monotonicEvents = ioctl(v->inputFd, EVIOCSCLOCKID, &clock) == 0;
+    if (!v->monotonicEvents) {
+        fsLogWarning("input device has no monotonic clock, using read times");
+    }
+
+    v->droppedEvents = false;
+    v->keys = 0;
+    v->keyEventCount = 0;
+    syncKeys(v);
+
     // Clear the cursor
     printf("\033[?25l");
     fflush(stdout);
@@ -239,7 +254,7 @@ i32 fsiGetTime(FSFrontend *v)
 
     struct timespec ts = {0, 0};
     clock_gettime(CLOCK_MONOTONIC, &ts);
-    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    return (i32) ((u32) ts.tv_sec * 1000000 + (u32) (ts.tv_nsec / 1000));
 }
 
 ///
@@ -272,52 +287,138 @@ void fsiSleep(FSFrontend *v, i32 time)
     }
 }
 
+///
+// Return the virtual keys mapped to the currently pressed physical keys.
+static u32 virtualKeys(const FSFrontend *v)
+{
+    u32 keys = 0;
+    for (int i = 0; i < FST_VK_COUNT; ++i) {
+        for (int j = 0; j < FS_MAX_KEYS_PER_ACTION; ++j) {
+            // Keystate is stored as a bitset in the array of chars
+            const int key = v->keymap[i][j].value;
+            if (key == KEY_NONE) {
+                break;
+            }
+
+            if (v->physicalKeys[key >> 3] & (1 << (key & 7))) {
+                keys |= FS_TO_FLAG(i);
+            }
+        }
+    }
+
+    return keys;
+}
+
+///
+// Record a virtual key change if the physical keys changed any.
+//
+// If the event buffer is full the last change is updated instead, so the final
+// state is never lost.
+static void pushKeys(FSFrontend *v, i32 time)
+{
+    const u32 keys = virtualKeys(v);
+    if (keys == v->keys) {
+        return;
+    }
+
+    v->keys = keys;
+    if (v->keyEventCount == FS_MAX_KEY_EVENTS) {
+        v->keyEventCount -= 1;
+    }
+
+    v->keyEvents[v->keyEventCount++] = (FSKeyEvent) { .time = time, .keys = keys };
+}
+
+///
+// Query the pressed physical keys directly from the device.
+//
+// This is required on startup and whenever the kernel drops events.
+static void syncKeys(FSFrontend *v)
+{
+    memset(v->physicalKeys, 0, sizeof(v->physicalKeys));
+    ioctl(v->inputFd, EVIOCGKEY(sizeof(v->physicalKeys)), v->physicalKeys);
+    pushKeys(v, fsiGetTime(v));
+}
+
+static i32 eventTime(FSFrontend *v, const struct input_event *ev)
+{
+    if (!v->monotonicEvents) {
+        return fsiGetTime(v);
+    }
+
+#ifdef input_event_sec
+    return (i32) ((u32) ev->input_event_sec * 1000000 + (u32) ev->input_event_usec);
+#else
+    return (i32) ((u32) ev->time.tv_sec * 1000000 + (u32) ev->time.tv_usec);
+#endif
+}
+
 ///
 // Return the found keypresses.
 //
-// Notes:
-//  * Can we replace the required getchar() with an ioctl call to mute the
-//    output on this terminal?
+// Every key event queued on the input device is read in batches and applied
+// in order, so a press and release between two calls is still seen. Each
+// resulting change of the virtual keys is available in `keyEvents` along with
+// the time the kernel received it.
 u32 fsiReadKeys(FSFrontend *v)
 {
-    char keystate[(KEY_MAX + 7) / 8] = {0};
-
     // We need to consume the characters that are pressed so they do not
-    // dump on game end. Empty periodically so queue can't grow large.
-    //
-    // We use ioctl to query if any input is pending so we can perform
-    // non-blocking reads.
-    while (1) {
-        int bp;
-        ioctl(STDOUT_FILENO, FIONREAD, &bp);
+    // dump on game end.
+    tcflush(STDIN_FILENO, TCIFLUSH);
+
+    v->keyEventCount = 0;
 
-        // If no bytes are pending stop getting input
-        if (bp == 0) {
+    struct input_event events[64];
+    while (1) {
+        const ssize_t n = read(v->inputFd, events, sizeof(events));
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN) {
+                fsLogError("Failed to read input device: %s", strerror(errno));
+            }
             break;
         }
 
-        (void) getchar();
-    }
+        for (size_t i = 0; i < n / sizeof(events[0]); ++i) {
+            const struct input_event *ev = &events[i];
 
-    // Fills buffer with current keystate
-    ioctl(v->inputFd, EVIOCGKEY(sizeof(keystate)), keystate);
+            // Events up to the next report are incomplete after a drop, so
+            // discard them and query the state once it is consistent again.
+            if (ev->type == EV_SYN) {
+                if (ev->code == SYN_DROPPED) {
+                    v->droppedEvents = true;
+                }
+                else if (ev->code == SYN_REPORT && v->droppedEvents) {
+                    v->droppedEvents = false;
+                    syncKeys(v);
+                }
+                continue;
+            }
 
-    u32 keys = 0;
-    for (int i = 0; i < FST_VK_COUNT; ++i) {
-        for (int j = 0; j < FS_MAX_KEYS_PER_ACTION; ++j) {
-            // Keystate is stored as a bitset in the array of chars
-            const int key = v->keymap[i][j].value;
-            if (key == KEY_NONE) {
-                break;
+            // Autorepeat (2) is ignored since DAS is handled by the engine.
+            if (v->droppedEvents || ev->type != EV_KEY || ev->code > KEY_MAX ||
+                    ev->value == 2) {
+                continue;
             }
 
-            if (keystate[key >> 3] & (1 << (key & 7))) {
-                keys |= FS_TO_FLAG(i);
+            if (ev->value) {
+                v->physicalKeys[ev->code >> 3] |= 1 << (ev->code & 7);
             }
+            else {
+                v->physicalKeys[ev->code >> 3] &= ~(1 << (ev->code & 7));
+            }
+
+            pushKeys(v, eventTime(v, ev));
+        }
+
+        if ((size_t) n < sizeof(events)) {
+            break;
         }
     }
 
-    return keys;
+    return v->keys;
 }
 
 ///
@@ -331,7 +432,8 @@ static uint16_t attr_colour(int piece)
         ATTR_YELLOW,    // O
         ATTR_GREEN,     // S
         ATTR_MAGENTA,   // T
-        ATTR_RED        // Z
+        ATTR_RED,       // Z
+        ATTR_WHITE | ATTR_DIM   // Garbage
     };
 
     if (piece < 0 || FS_NPT < piece) {
@@ -373,33 +475,35 @@ static void drawField(FSFrontend *v)
 
     ///
     // Border
-    v->bbuf[FIELD_Y + f->fieldHeight - f->fieldHidden][FIELD_X + 1].value = v->glyph.borderLB;
-    v->bbuf[FIELD_Y + f->fieldHeight - f->fieldHidden][FIELD_X + 2*f->fieldWidth + 2].value = v->glyph.borderRB;
+    v->bbuf[FIELD_Y + f->config->fieldHeight - f->config->fieldHidden][FIELD_X + 1].value = v->glyph.borderLB;
+    v->bbuf[FIELD_Y + f->config->fieldHeight - f->config->fieldHidden][FIELD_X + 2*f->config->fieldWidth + 2].value = v->glyph.borderRB;
 
-    for (int y = 0; y < f->fieldHeight - f->fieldHidden; ++y) {
+    for (int y = 0; y < f->config->fieldHeight - f->config->fieldHidden; ++y) {
         v->bbuf[FIELD_Y + y][FIELD_X + 1].value = v->glyph.borderL;
-        v->bbuf[FIELD_Y + y][FIELD_X + 2*f->fieldWidth + 2].value = v->glyph.borderR;
+        v->bbuf[FIELD_Y + y][FIELD_X + 2*f->config->fieldWidth + 2].value = v->glyph.borderR;
     }
 
-    for (int x = 0; x < 2 * f->fieldWidth; ++x) {
-        v->bbuf[FIELD_Y + f->fieldHeight - f->fieldHidden][FIELD_X + x + 2].value = v->glyph.borderB;
+    for (int x = 0; x < 2 * f->config->fieldWidth; ++x) {
+        v->bbuf[FIELD_Y + f->config->fieldHeight - f->config->fieldHidden][FIELD_X + x + 2].value = v->glyph.borderB;
     }
 
     ///
     // Field state
-    for (int y = f->fieldHidden; y < f->fieldHeight; ++y) {
-        for (int x = 0; x < f->fieldWidth; ++x) {
-            const uint16_t color = v->coloredField
-                                      ? attr_colour(fsFieldPieceBlock(f->b[y][x]))
+    for (int y = f->config->fieldHidden; y < f->config->fieldHeight; ++y) {
+        for (int x = 0; x < f->config->fieldWidth; ++x) {
+            const FSBlock block = fsGetFieldBlock(f, x, y);
+            // Garbage is always distinguished from the stack.
+            const uint16_t color = v->coloredField || block == FS_GARBAGE_BLOCK
+                                      ? attr_colour(fsFieldPieceBlock(block))
                                       : ATTR_WHITE;
 
             const TerminalCell sq = (TerminalCell) {
                 .value = v->glyph.blockE,
-                .attrs = f->b[y][x] ? ATTR_REVERSE | color : 0
+                .attrs = block ? ATTR_REVERSE | color : 0
             };
 
-            v->bbuf[FIELD_Y + (y - f->fieldHidden)][FIELD_X + 2*x + 2] = sq;
-            v->bbuf[FIELD_Y + (y - f->fieldHidden)][FIELD_X + 2*x + 3] = sq;
+            v->bbuf[FIELD_Y + (y - f->config->fieldHidden)][FIELD_X + 2*x + 2] = sq;
+            v->bbuf[FIELD_Y + (y - f->config->fieldHidden)][FIELD_X + 2*x + 3] = sq;
         }
     }
 
@@ -409,7 +513,7 @@ static void drawField(FSFrontend *v)
 
     ///
     // Current piece ghost
-    fsGetBlocks(f, blocks, f->piece, f->x, f->hardDropY - f->fieldHidden, f->theta);
+    fsGetBlocks(f, blocks, f->piece, f->x, f->hardDropY - f->config->fieldHidden, f->theta);
     for (int i = 0; i < FS_NBP; ++i) {
         if (blocks[i].y < 0) {
             continue;
@@ -427,7 +531,7 @@ static void drawField(FSFrontend *v)
 
     ///
     // Current piece
-    fsGetBlocks(f, blocks, f->piece, f->x, f->y - f->fieldHidden, f->theta);
+    fsGetBlocks(f, blocks, f->piece, f->x, f->y - f->config->fieldHidden, f->theta);
     for (int i = 0; i < FS_NBP; ++i) {
         if (blocks[i].y < 0) {
             continue;
@@ -453,13 +557,14 @@ static void drawPreview(FSFrontend *v)
 {
     i8x2 blocks[FS_NBP];
     const FSEngine *f = v->view->game;
-    const int previewCount = f->nextPieceCount > FS_MAX_PREVIEW_COUNT
-                                ? FS_MAX_PREVIEW_COUNT
-                                : f->nextPieceCount;
+    const int previewCount = f->config->nextPieceCount > FS_MAX_PREVIEW_DRAWN
+                                ? FS_MAX_PREVIEW_DRAWN
+                                : f->config->nextPieceCount;
 
     for (int i = 0; i < previewCount; ++i) {
-        fsGetBlocks(f, blocks, f->nextPiece[i], 0, 0, 0);
-        const int xpo = f->nextPiece[i] == FS_I || f->nextPiece[i] == FS_O ? 0 : 1;
+        const FSBlock pid = fsGetNextPiece(f, i);
+        fsGetBlocks(f, blocks, pid, 0, 0, 0);
+        const int xpo = pid == FS_I || pid == FS_O ? 0 : 1;
 
         for (int j = 0; j < FS_NBP; ++j) {
             const int xo = PVIEW_X + xpo + 2 * blocks[j].x;
@@ -467,11 +572,11 @@ static void drawPreview(FSFrontend *v)
 
             v->bbuf[yo][xo] = (TerminalCell) {
                 .value = v->glyph.blockL,
-                .attrs = ATTR_REVERSE | attr_colour(f->nextPiece[i])
+                .attrs = ATTR_REVERSE | attr_colour(pid)
             };
             v->bbuf[yo][xo + 1] = (TerminalCell) {
                 .value = v->glyph.blockR,
-                .attrs = ATTR_REVERSE | attr_colour(f->nextPiece[i])
+                .attrs = ATTR_REVERSE | attr_colour(pid)
             };
         }
     }
@@ -520,7 +625,7 @@ static void drawInfo(FSFrontend *v)
     char buf[bufsiz];
 
     // Target Goal is special and is drawn under the field.
-    int remaining = v->view->game->goal - v->view->game->linesCleared;
+    int remaining = v->view->game->config->goal - v->view->game->linesCleared;
     if (remaining < 0) {
         remaining = 0;
     }
@@ -529,7 +634,7 @@ static void drawInfo(FSFrontend *v)
     putStrAt(v, buf, FIELD_Y + FIELD_H + 1,
                 FIELD_X + FIELD_W / 2 - strlen(buf) / 2 + 1, ATTR_BRIGHT);
 
-    const int msElapsed = f->msPerTick * f->totalTicks;
+    const int msElapsed = f->config->msPerTick * f->totalTicks;
 
 
     // Remaining items are drawn on the right-side of the field.
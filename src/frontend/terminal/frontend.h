@@ -28,8 +28,8 @@
 // Field offsets
 #define FIELD_X (HOLD_X + HOLD_W + 1)
 #define FIELD_Y HOLD_Y
-#define FIELD_H (f->fieldHeight - f->fieldHidden + 1)
-#define FIELD_W (2 * f->fieldWidth + 2)
+#define FIELD_H (f->config->fieldHeight - f->config->fieldHidden + 1)
+#define FIELD_W (2 * f->config->fieldWidth + 2)
 
 // Preview offsets
 #define PVIEW_X (FIELD_X + FIELD_W + 2)
@@ -101,6 +101,22 @@ struct FSFrontend {
     /// File descriptor of currently open input device.
     int inputFd;
 
+    /// Are input event timestamps on the `fsiGetTime` clock?
+    bool monotonicEvents;
+
+    /// Were input events dropped by the kernel since the last report?
+    bool droppedEvents;
+
+    /// Physical keys currently pressed, as a bitset indexed by key code.
+    uint8_t physicalKeys[(KEY_MAX + 7) / 8];
+
+    /// Virtual keys currently pressed.
+    u32 keys;
+
+    /// Virtual key changes read by the last `fsiReadKeys` call, oldest first.
+    FSKeyEvent keyEvents[FS_MAX_KEY_EVENTS];
+    int keyEventCount;
+
     /// Initial terminal state.
     struct termios initialTerminalState;
 
@@ -0,0 +1,3 @@
+#include "framework.h"
+
+int failures = 0;
@@ -2,7 +2,19 @@
 #define FRAMEWORK_H
 
 #include "faststack.h"
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+// Number of failed checks. A test reports it and exits non-zero if any failed.
+extern int failures;
+
+#define CHECK(cond)                                                             \
+do {                                                                            \
+    if (!(cond)) {                                                              \
+        printf("    FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);              \
+        failures += 1;                                                          \
+    }                                                                           \
+} while (0)
+
 #endif
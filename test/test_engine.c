@@ -0,0 +1,754 @@
+// test_engine.c
+// =============
+//
+// Tests the headless engine interfaces. Games are driven by a pseudo-random
+// key stream so each run covers movement, rotation, holds and line clears.
+
+#include "framework.h"
+#include <stdio.h>
+
+#define TICK_COUNT 20000
+
+static u32 keys[TICK_COUNT];
+
+// Generate a key stream which taps keys often enough to place pieces.
+static void generateKeys(u32 seed)
+{
+    FSRandCtx ctx;
+    fsRandSeed(&ctx, seed);
+
+    u32 state = 0;
+    for (int i = 0; i < TICK_COUNT; ++i) {
+        const u32 r = fsRandNext(&ctx);
+        if ((r & 3) == 0) {
+            state = fsRandNext(&ctx) & (FST_VK_FLAG_DOWN | FST_VK_FLAG_LEFT |
+                                        FST_VK_FLAG_RIGHT | FST_VK_FLAG_ROTL |
+                                        FST_VK_FLAG_ROTR | FST_VK_FLAG_HOLD);
+        }
+        if ((r & 31) == 1) {
+            state |= FST_VK_FLAG_UP;
+        }
+        keys[i] = state;
+    }
+}
+
+// Options shared by every engine under test.
+static FSEngineConfig config;
+
+// Adjusts the options of a test before its engine is initialized.
+typedef void (*ConfigHook)(FSEngineConfig *c);
+
+static void initEngine(FSEngine *f, FSControl *c, u32 seed, ConfigHook hook)
+{
+    fsConfigInit(&config);
+    config.fieldWidth = 4;
+    config.goal = 10000;
+    if (hook) {
+        hook(&config);
+    }
+    fsGameInit(f, &config);
+    f->seed = seed;
+    fsGameReset(f);
+    memset(c, 0, sizeof(*c));
+}
+
+// The incrementally maintained row masks, row fills and column heights must
+// match the field contents.
+static void checkFieldCounts(const FSEngine *f)
+{
+    for (int y = 0; y < f->config->fieldHeight; ++y) {
+        int fill = 0;
+        for (int x = 0; x < f->config->fieldWidth; ++x) {
+            const bool filled = fsGetFieldBlock(f, x, y) != 0;
+            fill += filled;
+            CHECK(((f->rowMask[y] >> (x + FS_ROW_PAD)) & 1) == filled);
+        }
+        CHECK(f->rowFill[y] == fill);
+    }
+
+    for (int x = 0; x < f->config->fieldWidth; ++x) {
+        int height = 0;
+        for (int y = f->config->fieldHeight - 1; y >= 0; --y) {
+            if (fsGetFieldBlock(f, x, y)) {
+                height = f->config->fieldHeight - y;
+            }
+        }
+        CHECK(f->columnHeight[x] == height);
+    }
+}
+
+static void test_run_inputs(void)
+{
+    printf("\nRun Inputs\n");
+
+    FSEngine a, b;
+    FSControl ca, cb;
+    FSGameStats stats;
+
+    generateKeys(1);
+    initEngine(&a, &ca, 42, NULL);
+    initEngine(&b, &cb, 42, NULL);
+
+    // A headless run must match ticking one input at a time.
+    const i32 ticks = fsGameRunInputs(&a, &ca, keys, TICK_COUNT, &stats);
+
+    i32 n = 0;
+    while (n < TICK_COUNT && b.state != FSS_GAMEOVER) {
+        FSInput in = {0, 0, 0, 0, 0, 0, 0};
+        fsVirtualKeysToInput(&in, keys[n++], &b, &cb);
+        fsGameTick(&b, &in);
+    }
+
+    printf("    ticks = %d, lines = %d, blocks = %d\n",
+            ticks, stats.linesCleared, stats.blocksPlaced);
+
+    CHECK(ticks == n);
+    CHECK(stats.totalTicksRaw == b.totalTicksRaw);
+    CHECK(stats.linesCleared == b.linesCleared);
+    CHECK(stats.blocksPlaced == b.blocksPlaced);
+    CHECK(stats.finesse == b.finesse);
+    CHECK(stats.state == b.state);
+    CHECK(!memcmp(a.b, b.b, sizeof(a.b)));
+    CHECK(stats.linesCleared > 0);
+    checkFieldCounts(&a);
+}
+
+static void test_key_events(void)
+{
+    printf("\nKey Events\n");
+
+    FSEngine a, b;
+    FSControl ca, cb;
+
+    generateKeys(3);
+    initEngine(&a, &ca, 42, NULL);
+    initEngine(&b, &cb, 42, NULL);
+
+    // Changes at the start of each tick must match the per-tick key state.
+    for (int n = 0; n < TICK_COUNT && a.state != FSS_GAMEOVER; ++n) {
+        FSInput in = {0, 0, 0, 0, 0, 0, 0};
+        fsVirtualKeysToInput(&in, keys[n], &a, &ca);
+        fsGameTick(&a, &in);
+
+        const FSKeyEvent event = { 0, keys[n] };
+        fsGameTickEvents(&b, &cb, &event, 1, 0);
+    }
+
+    CHECK(a.totalTicksRaw == b.totalTicksRaw);
+    CHECK(a.blocksPlaced == b.blocksPlaced);
+    CHECK(a.totalKeysPressed == b.totalKeysPressed);
+    CHECK(!memcmp(a.b, b.b, sizeof(a.b)));
+
+    // A tap made and released within a tick still moves the piece.
+    initEngine(&a, &ca, 42, NULL);
+    config.fieldWidth = 10;
+    fsGameReset(&a);
+    while (a.state != FSS_FALLING) {
+        fsGameTickEvents(&a, &ca, NULL, 0, 0);
+    }
+
+    const int x = a.x;
+    const i32 length = a.config->msPerTick * 1000;
+    const FSKeyEvent tap[] = {
+        { length / 4, FST_VK_FLAG_RIGHT },
+        { length / 2, 0 },
+    };
+    fsGameTickEvents(&a, &ca, tap, 2, 0);
+    CHECK(a.x == x + 1);
+
+    // The same tap on a clock which wraps part way through the tick.
+    const i32 start = fsTimeAdd(INT32_MAX, -length / 3);
+    const FSKeyEvent wrapped[] = {
+        { fsTimeAdd(start, length / 4), FST_VK_FLAG_RIGHT },
+        { fsTimeAdd(start, length / 2), 0 },
+    };
+    fsGameTickEvents(&a, &ca, wrapped, 2, start);
+    CHECK(a.x == x + 2);
+
+    // A hard drop part way through a tick locks the piece in that tick.
+    const i32 blocks = a.blocksPlaced;
+    const FSKeyEvent drop[] = {
+        { length / 4, FST_VK_FLAG_LEFT },
+        { length / 2, FST_VK_FLAG_LEFT | FST_VK_FLAG_UP },
+    };
+    fsGameTickEvents(&a, &ca, drop, 2, 0);
+    CHECK(a.blocksPlaced == blocks + 1);
+
+    // Soft drop held for half a tick falls half as far as a full tick.
+    initEngine(&a, &ca, 42, NULL);
+    config.gravity = 0;
+    config.softDropGravity = 2000000 / a.config->msPerTick;
+    fsGameReset(&a);
+    while (a.state != FSS_FALLING) {
+        fsGameTickEvents(&a, &ca, NULL, 0, 0);
+    }
+
+    const int y = a.y;
+    const FSKeyEvent full = { 0, FST_VK_FLAG_DOWN };
+    const FSKeyEvent half = { length / 2, 0 };
+    fsGameTickEvents(&a, &ca, &full, 1, 0);
+    CHECK(a.y == y + 2);
+    fsGameTickEvents(&a, &ca, &half, 1, 0);
+    CHECK(a.y == y + 3);
+
+    // A hold tapped and released during ARE is still an initial hold.
+    initEngine(&a, &ca, 42, NULL);
+    config.initialActionStyle = FST_IA_PERSISTENT;
+    fsGameReset(&a);
+    while (a.state != FSS_FALLING) {
+        fsGameTickEvents(&a, &ca, NULL, 0, 0);
+    }
+
+    const FSKeyEvent hardDrop[] = {
+        { 0, FST_VK_FLAG_UP },
+        { length / 2, 0 },
+    };
+    fsGameTickEvents(&a, &ca, hardDrop, 2, 0);
+    CHECK(a.holdPiece == FS_NONE);
+
+    const FSKeyEvent hold[] = {
+        { length / 4, FST_VK_FLAG_HOLD },
+        { length / 2, 0 },
+    };
+    while (a.state != FSS_FALLING) {
+        fsGameTickEvents(&a, &ca, hold, 2, 0);
+    }
+    CHECK(a.holdPiece != FS_NONE);
+}
+
+static void test_das(void)
+{
+    printf("\nDAS\n");
+
+    FSEngine f;
+    FSControl c;
+
+    // An ARR shorter than a tick moves every cell it passes within the tick.
+    initEngine(&f, &c, 42, NULL);
+    config.fieldWidth = 10;
+    config.dasDelay = 50;
+    config.dasSpeed = 3000;
+
+    const i32 length = f.config->msPerTick * 1000;
+    i32 moved = 0;
+    for (int n = 0; n < 8; ++n) {
+        FSInput in = {0, 0, 0, 0, 0, 0, 0};
+        fsVirtualKeysToInput(&in, FST_VK_FLAG_RIGHT, &f, &c);
+        moved += in.movement;
+
+        // The initial move plus every repeat by the end of this tick.
+        const i32 held = (n + 1) * length;
+        const i32 expected = 1 + (held >= 50000 ? (held - 50000) / 3000 + 1 : 0);
+        CHECK(moved == expected);
+    }
+    printf("    %d cells in %d us\n", moved, 8 * length);
+
+    // A change part way through a tick starts DAS at that time. Held for 2 ms
+    // of one tick and all of the next, a 17 ms delay has passed.
+    initEngine(&f, &c, 42, NULL);
+    config.dasDelay = 17;
+    config.dasSpeed = 0;
+
+    FSInput in = {0, 0, 0, 0, 0, 0, 0};
+    fsVirtualKeysToPartialInput(&in, FST_VK_FLAG_LEFT, length - 2000, &f, &c);
+    CHECK(in.movement == -1);
+    memset(&in, 0, sizeof(in));
+    fsVirtualKeysToInput(&in, FST_VK_FLAG_LEFT, &f, &c);
+    CHECK(in.movement == 0);
+    memset(&in, 0, sizeof(in));
+    fsVirtualKeysToInput(&in, FST_VK_FLAG_LEFT, &f, &c);
+    CHECK(in.movement == -config.fieldWidth);
+}
+
+static void test_fast_tick(void)
+{
+    printf("\nFast Tick\n");
+
+    FSEngine a, b;
+    FSControl ca, cb;
+    static FSEngineConfig fast;
+
+    // Soft drop slower than a row per tick must still accumulate, so 16 ticks
+    // of 1 ms fall as far as one tick of 16 ms.
+    initEngine(&a, &ca, 42, NULL);
+    config.gravity = 0;
+    config.softDropGravity = 250000;
+    config.msPerTick = 16;
+    config.readyPhaseLength = 0;
+    config.goPhaseLength = 0;
+    fsGameReset(&a);
+
+    fast = config;
+    fast.msPerTick = 1;
+    fsGameInit(&b, &fast);
+    b.seed = a.seed;
+    fsGameReset(&b);
+    memset(&cb, 0, sizeof(cb));
+
+    while (a.state != FSS_FALLING) {
+        fsGameTickEvents(&a, &ca, NULL, 0, 0);
+    }
+    while (b.state != FSS_FALLING) {
+        fsGameTickEvents(&b, &cb, NULL, 0, 0);
+    }
+    CHECK(a.y == b.y);
+
+    const int y = a.y;
+    const FSKeyEvent down = { 0, FST_VK_FLAG_DOWN };
+    for (int n = 0; n < 4; ++n) {
+        fsGameTickEvents(&a, &ca, &down, 1, 0);
+        for (int m = 0; m < 16; ++m) {
+            fsGameTickEvents(&b, &cb, &down, 1, 0);
+        }
+        CHECK(a.y == b.y);
+        CHECK(a.actualY == b.actualY);
+    }
+
+    CHECK(a.y > y);
+    printf("    fell %d rows\n", a.y - y);
+}
+
+static void test_max_field(void)
+{
+    printf("\nMaximum Field\n");
+
+    FSEngine f;
+    FSControl c;
+    FSGameStats stats;
+
+    // Narrow to fill rows quickly, then the full size to test the row masks
+    // and clears at the limits.
+    const int widths[] = { 4, FS_MAX_WIDTH };
+    for (int i = 0; i < 2; ++i) {
+        generateKeys(4 + i);
+        initEngine(&f, &c, 11, NULL);
+        config.fieldWidth = widths[i];
+        config.fieldHeight = FS_MAX_HEIGHT;
+        fsGameReset(&f);
+
+        fsGameRunInputs(&f, &c, keys, TICK_COUNT, &stats);
+        printf("    %dx%d: lines = %d, blocks = %d\n",
+                config.fieldWidth, config.fieldHeight, stats.linesCleared,
+                stats.blocksPlaced);
+
+        CHECK(stats.blocksPlaced > 0);
+        checkFieldCounts(&f);
+    }
+}
+
+static void test_snapshot_seek(void)
+{
+    printf("\nSnapshot Seek\n");
+
+    static FSSnapshotRing ring;
+    static FSReplayEvent events[TICK_COUNT];
+    FSEngine a, b;
+    FSControl ca, cb;
+
+    generateKeys(2);
+    initEngine(&a, &ca, 7, NULL);
+    initEngine(&b, &cb, 0, NULL);
+
+    // Record the key changes as a replay would, with every other change made
+    // part way through its tick.
+    const i32 length = a.config->msPerTick * 1000;
+    i32 count = 0;
+    u32 last = 0;
+    for (i32 t = 0; t < TICK_COUNT; ++t) {
+        if (keys[t] != last) {
+            events[count] = (FSReplayEvent) { t, (count & 1) * length / 3, keys[t] };
+            count += 1;
+            last = keys[t];
+        }
+    }
+
+    // Play a full game, keeping the state at a specific tick.
+    const i32 target = 200;
+    FSEngineSnapshot expected;
+
+    fsSnapshotRingInit(&ring, 4, &a, &ca);
+    for (i32 t = 0, k = 0; t < TICK_COUNT && a.state != FSS_GAMEOVER; ++t) {
+        FSKeyEvent event;
+        i32 n = 0;
+        if (k < count && events[k].tick == (u32) t) {
+            event = (FSKeyEvent) { events[k].time, events[k].keys };
+            n = 1;
+            k += 1;
+        }
+        fsGameTickEvents(&a, &ca, &event, n, 0);
+        fsSnapshotRingUpdate(&ring, &a, &ca);
+        if (a.totalTicksRaw == target) {
+            fsEngineSnapshot(&a, &ca, &expected);
+        }
+    }
+
+    printf("    ticks = %d, snapshots = %d\n", a.totalTicksRaw, ring.count);
+    CHECK(a.totalTicksRaw > target);
+
+    // Seeking from any position must reach the identical state, using the
+    // seed and options of the ring. Seek beyond the retained ring entries
+    // first so the initial snapshot is used.
+    FSEngineSnapshot actual;
+    CHECK(fsSnapshotRingSeek(&ring, &b, &cb, events, count, 50) == 50);
+    CHECK(b.seed == a.seed);
+
+    const i32 reached = fsSnapshotRingSeek(&ring, &b, &cb, events, count, target);
+    fsEngineSnapshot(&b, &cb, &actual);
+
+    CHECK(reached == target);
+    CHECK(!memcmp(&expected, &actual, sizeof(expected)));
+
+    // Seeking past the end of the game stops once it is over.
+    CHECK(fsSnapshotRingSeek(&ring, &b, &cb, events, count, INT32_MAX) == a.totalTicksRaw);
+    CHECK(b.state == a.state);
+    CHECK(b.linesCleared == a.linesCleared);
+    CHECK(!memcmp(a.b, b.b, sizeof(a.b)));
+}
+
+// Apply a single placement move as the engine input for one tick.
+static void applyMove(FSEngine *f, i8 move)
+{
+    FSInput in = {0, 0, 0, 0, 0, 0, 0};
+
+    switch (move) {
+      case FST_MOVE_LEFT:  in.movement = -1; break;
+      case FST_MOVE_RIGHT: in.movement = 1; break;
+      case FST_MOVE_ROTR:  in.rotation = FST_ROT_CLOCKWISE; break;
+      case FST_MOVE_ROTL:  in.rotation = FST_ROT_ANTICLOCKWISE; break;
+      case FST_MOVE_ROTH:  in.rotation = FST_ROT_HALFTURN; break;
+      case FST_MOVE_DOWN:  in.gravity = 1; break;
+      case FST_MOVE_DROP:  in.gravity = f->config->fieldHeight; break;
+    }
+
+    fsGameTick(f, &in);
+}
+
+// Options for driving an engine one placement at a time. Pieces never fall
+// or lock on their own, so they only move as a placement path directs.
+static void placementConfig(FSEngineConfig *c)
+{
+    c->fieldWidth = FSD_FIELD_WIDTH;
+    c->gravity = 0;
+    c->lockDelay = 100000;
+    c->readyPhaseLength = 0;
+    c->goPhaseLength = 0;
+}
+
+// Tick until a piece can be placed. Returns false if the game ended first.
+static bool waitForPiece(FSEngine *f)
+{
+    while (f->state != FSS_FALLING && f->state != FSS_GAMEOVER) {
+        applyMove(f, -1);
+    }
+
+    return f->state == FSS_FALLING;
+}
+
+// Move the current piece along the path to its lowest placement and hard
+// drop it. Equally low placements are chosen between at random with `ctx`,
+// or the first is kept if it is NULL.
+//
+// Returns the number of placements which were available, 0 if none.
+static i32 dropLowest(FSEngine *f, FSRandCtx *ctx)
+{
+    static FSPlacement placements[512];
+
+    const i32 n = fsGeneratePlacements(f, placements, 512);
+    CHECK(n > 0);
+    if (n == 0) {
+        return 0;
+    }
+
+    const FSPlacement *p = &placements[0];
+    for (int i = 1; i < n; ++i) {
+        if (placements[i].y > p->y ||
+                (ctx && placements[i].y == p->y && fsRandNext(ctx) % 4 == 0)) {
+            p = &placements[i];
+        }
+    }
+
+    // Every path must lead the engine to its resting position.
+    for (int i = 0; i < p->pathLength; ++i) {
+        applyMove(f, p->path[i]);
+    }
+
+    CHECK(f->x == p->x && f->y == p->y && f->theta == p->theta);
+    CHECK(f->hardDropY == p->y);
+
+    FSInput drop = {0, 0, 0, FST_INPUT_HARD_DROP, 0, 0, 0};
+    fsGameTick(f, &drop);
+    return n;
+}
+
+// Every placement found by dropping alone must also be found by the full
+// search, with a path which never moves down a single row.
+static void checkDropPlacements(const FSEngine *f)
+{
+    static FSPlacement all[512], dropped[512];
+    const i32 n = fsGeneratePlacements(f, all, 512);
+    const i32 m = fsGenerateDropPlacements(f, dropped, 512);
+
+    CHECK(0 < m && m <= n);
+    for (i32 i = 0; i < m; ++i) {
+        bool found = false;
+        for (i32 j = 0; j < n && !found; ++j) {
+            found = all[j].x == dropped[i].x && all[j].y == dropped[i].y &&
+                    all[j].theta == dropped[i].theta;
+        }
+        CHECK(found);
+
+        for (int j = 0; j < dropped[i].pathLength; ++j) {
+            CHECK(dropped[i].path[j] != FST_MOVE_DOWN);
+        }
+    }
+}
+
+static void test_placements(void)
+{
+    printf("\nPlacements\n");
+
+    FSRandCtx ctx;
+    fsRandSeed(&ctx, 3);
+
+    for (int rs = 0; rs < FS_NRS; ++rs) {
+        FSEngine f;
+        FSControl c;
+        initEngine(&f, &c, rs, placementConfig);
+        config.rotationSystem = rs;
+        fsGameReset(&f);
+
+        // Prefer low placements so the stack stays flat enough to clear lines
+        // and produce tucks and spins.
+        int pieces = 0, total = 0;
+        while (pieces < 200 && waitForPiece(&f)) {
+            checkDropPlacements(&f);
+
+            const i32 n = dropLowest(&f, &ctx);
+            if (n == 0) {
+                break;
+            }
+
+            checkFieldCounts(&f);
+            pieces += 1;
+            total += n;
+        }
+
+        printf("    rotation system %d: %d pieces, %.1f placements/piece, %d lines\n",
+                rs, pieces, (double) total / pieces, f.linesCleared);
+    }
+}
+
+static void test_garbage(void)
+{
+    printf("\nGarbage\n");
+
+    FSRandCtx ctx;
+    fsRandSeed(&ctx, 5);
+
+    FSEngine f;
+    FSControl c;
+    initEngine(&f, &c, 9, placementConfig);
+
+    fsAddGarbage(&f, 3, 2);
+    checkFieldCounts(&f);
+    for (int x = 0; x < f.config->fieldWidth; ++x) {
+        CHECK(fsGetFieldBlock(&f, x, f.config->fieldHeight - 1) ==
+                (x == 2 ? 0 : FS_GARBAGE_BLOCK));
+        CHECK(f.columnHeight[x] == (x == 2 ? 0 : 3));
+    }
+    CHECK(fsFieldPieceBlock(FS_GARBAGE_BLOCK) == FS_NPT);
+
+    int pieces = 0;
+    while (pieces < 100 && waitForPiece(&f)) {
+        // Garbage arriving under an active piece must never overlap it.
+        if (pieces % 4 == 3) {
+            fsAddGarbage(&f, 1 + pieces % 3, fsRandNext(&ctx) % f.config->fieldWidth);
+            checkFieldCounts(&f);
+            if (f.state == FSS_GAMEOVER) {
+                break;
+            }
+            CHECK(!fsIsMaskCollision(&f,
+                    &pieceMasks[f.config->rotationSystem][f.piece][f.theta], f.x, f.y));
+        }
+
+        if (dropLowest(&f, NULL) == 0) {
+            break;
+        }
+        checkFieldCounts(&f);
+        pieces += 1;
+
+        // Nor may it overlap a dropped piece which is yet to be locked.
+        if (pieces % 4 == 2 && f.state == FSS_LINES) {
+            fsAddGarbage(&f, 1, fsRandNext(&ctx) % f.config->fieldWidth);
+            checkFieldCounts(&f);
+            if (f.state == FSS_GAMEOVER) {
+                break;
+            }
+            CHECK(!fsIsMaskCollision(&f,
+                    &pieceMasks[f.config->rotationSystem][f.piece][f.theta], f.x, f.y));
+        }
+    }
+
+    printf("    %d pieces, %d lines\n", pieces, f.linesCleared);
+    CHECK(f.linesCleared > 0);
+}
+
+// Spawned pieces and the preview must follow the randomizer sequence, for a
+// short preview, a preview which wraps around the ring and a full ring.
+static void test_preview(void)
+{
+    printf("\nPreview\n");
+
+    static FSBlock sequence[100 + FS_MAX_PREVIEW_COUNT + 1];
+    const int counts[] = { 1, FS_MAX_PREVIEW_COUNT - 3, FS_MAX_PREVIEW_COUNT };
+
+    for (int i = 0; i < 3; ++i) {
+        FSEngine f;
+        FSControl c;
+        initEngine(&f, &c, 21, placementConfig);
+        config.nextPieceCount = counts[i];
+        fsGameReset(&f);
+
+        FSRandCtx ctx;
+        FSRandState state;
+        fsRandSeed(&ctx, f.seed);
+        fsRandStateInit(&ctx, &state, config.randomizer);
+        fsRandFill(&ctx, &state, sequence, sizeof(sequence));
+
+        // Keep the stack low by taking the lowest placement.
+        int pieces = 0;
+        while (pieces < 100 && waitForPiece(&f)) {
+            CHECK(f.piece == sequence[pieces]);
+            for (int j = 0; j < counts[i]; ++j) {
+                CHECK(fsGetNextPiece(&f, j) == sequence[pieces + 1 + j]);
+            }
+
+            if (dropLowest(&f, NULL) == 0) {
+                break;
+            }
+            pieces += 1;
+        }
+
+        printf("    %d previewed: %d pieces\n", counts[i], pieces);
+        CHECK(pieces > 20);
+    }
+}
+
+// Percentiles must be exact in the linear range and within a bucket above it.
+static void test_latency(void)
+{
+    printf("\nLatency\n");
+
+    static FSLatency l;
+    fsLatencyInit(&l);
+
+    // Key changes at 0..99 us, all consumed at 100 us and drawn at 1100 us.
+    // Changes beyond those which can wait for a frame are not drawn.
+    for (i32 i = 0; i < 100; ++i) {
+        fsLatencyConsume(&l, i, 100);
+    }
+    fsLatencyBlit(&l, 1100);
+    CHECK(l.pendingCount == 0);
+    CHECK(l.dropped == 100 - FS_MAX_KEY_EVENTS);
+    CHECK(l.readToBlit.count == FS_MAX_KEY_EVENTS);
+
+    CHECK(l.readToTick.count == 100);
+    CHECK(l.readToTick.max == 100);
+    CHECK(fsLatencyPercentile(&l.readToTick, 0) <= 1);
+    CHECK(fsLatencyPercentile(&l.readToTick, 100) == 100);
+
+    const i32 p50 = fsLatencyPercentile(&l.readToTick, 50);
+    CHECK(p50 >= 51 && p50 <= 51 + 51 / 16);
+
+    CHECK(fsLatencyPercentile(&l.tickToBlit, 50) == 1000);
+    const i32 p99 = fsLatencyPercentile(&l.readToBlit, 99);
+    CHECK(p99 >= 1099 && p99 <= 1100);
+
+    fsLatencyConsume(&l, 0, 1 << 30);
+    CHECK(fsLatencyPercentile(&l.readToTick, 100) == 1 << 30);
+    CHECK(fsLatencyPercentile(&l.readToTick, 50) == p50);
+
+    printf("    p50 %d us, p99 %d us\n", p50, p99);
+}
+
+// Replays must decode to the same header and key changes they were encoded
+// from, and a truncated change must be rejected.
+static void test_replay_codec(void)
+{
+    printf("\nReplay codec\n");
+
+    static u8 data[FS_REPLAY_HEADER_MAX + TICK_COUNT * FS_REPLAY_EVENT_MAX];
+    static FSReplayEvent events[TICK_COUNT];
+    FSEngineConfig encoded, decoded;
+    FSReplayEvent last = { 0, 0, 0 };
+    i32 count = 0;
+    u32 seed;
+
+    fsConfigInit(&encoded);
+    encoded.gravity = -1;
+    encoded.dasSpeed = 0;
+    encoded.msPerTick = 1;
+
+    generateKeys(7);
+    i32 n = fsReplayEncodeHeader(data, 0xdeadbeef, &encoded);
+    CHECK(n <= FS_REPLAY_HEADER_MAX);
+
+    for (i32 i = 0; i < TICK_COUNT; ++i) {
+        if (keys[i] != last.keys) {
+            const FSReplayEvent e = { i, (i * 37) % 16000, keys[i] };
+            n += fsReplayEncodeEvent(&data[n], &last, &e);
+            events[count++] = e;
+            last = e;
+        }
+    }
+
+    memset(&decoded, 0, sizeof(decoded));
+    i32 pos = fsReplayDecodeHeader(data, n, &seed, &decoded);
+    CHECK(pos > 0);
+    CHECK(seed == 0xdeadbeef);
+    CHECK(decoded.gravity == -1 && decoded.msPerTick == 1);
+    CHECK(decoded.dasDelay == encoded.dasDelay);
+    CHECK(decoded.nextPieceCount == encoded.nextPieceCount);
+
+    i32 matched = 0;
+    memset(&last, 0, sizeof(last));
+    while (pos < n) {
+        FSReplayEvent e;
+        const i32 r = fsReplayDecodeEvent(&data[pos], n - pos, &last, &e);
+        CHECK(r > 0);
+        if (r <= 0) {
+            break;
+        }
+
+        matched += e.tick == events[matched].tick && e.time == events[matched].time &&
+                   e.keys == events[matched].keys;
+        pos += r;
+        last = e;
+    }
+    CHECK(matched == count);
+
+    FSReplayEvent e;
+    memset(&last, 0, sizeof(last));
+    CHECK(fsReplayDecodeEvent(data, 0, &last, &e) < 0);
+    CHECK(fsReplayDecodeHeader(data, 2, &seed, &decoded) < 0);
+
+    printf("    %d changes in %d bytes\n", count, n);
+}
+
+int main(void)
+{
+    test_run_inputs();
+    test_key_events();
+    test_das();
+    test_fast_tick();
+    test_max_field();
+    test_snapshot_seek();
+    test_placements();
+    test_garbage();
+    test_preview();
+    test_latency();
+    test_replay_codec();
+
+    printf("\n%s\n", failures ? "FAILED" : "OK");
+    return failures != 0;
+}
@@ -25,8 +25,11 @@
 // Finesse is currently only applicable for standard 10-width playfields.
 void initFinesseTest(FSEngine *f)
 {
-    fsGameInit(f);
-    f->fieldWidth = 10;
+    static FSEngineConfig config;
+
+    fsConfigInit(&config);
+    config.fieldWidth = 10;
+    fsGameInit(f, &config);
 }
 
 // Reset the playfield with a new piece at the specified location.
@@ -36,7 +39,7 @@ void resetFinesseTest(FSEngine *f, int pieceType)
     f->state = FSS_FALLING;
     f->piece = pieceType;
 
-    f->x = f->fieldWidth / 2 - 2;
+    f->x = f->config->fieldWidth / 2 - 2;
     f->y = 1;
     f->actualY = fix(f->y);
     f->theta = 0;
@@ -47,6 +50,7 @@ static void iTest(void)
     FSEngine f;
     FSInput in;
 
+    initFinesseTest(&f);
     resetFinesseTest(&f, FS_I);
 
     memset(&in, 0, sizeof(in));
@@ -65,8 +69,5 @@ static void iTest(void)
 
 int main(void)
 {
-    FSEngine f;
-    initFinesseTest(&f);
-
     iTest();
 }
@@ -5,6 +5,12 @@
 // for generating each piece. All output is dumped every run which can help
 // when comparing the behaviour of different randomizers.
 //
+// Each randomizer is sampled over many independently seeded streams which are
+// split across threads. Every stream has a fixed seed and length, so the
+// merged results are identical for any thread count.
+//
+// Usage: test_randomizer [-t threads] [-n pieces] [-s seed]
+//
 // See this thread for some useful reading:
 //  https://tetrisconcept.net/threads/randomizer-theory.512/
 //
@@ -32,6 +38,8 @@
 // 4 history strict: 6
 // TGM3 (sample): ~5.31
 
+#define _POSIX_C_SOURCE 200112L
+
 #define VARIANCE_MEMORYLESS 42
 #define VARIANCE_6_BAG 12.8333f
 #define VARIANCE_7_BAG 8
@@ -45,12 +53,24 @@
 
 #define VARIANCE_ALLOWANCE 0.1f
 
+// Critical value of the chi-squared distribution with 6 degrees of freedom
+// (one per piece type, less one) at a significance level of 0.001.
+#define CHI_SQUARED_CRITICAL 22.458
+
+// Pieces generated from each seed.
+#define STREAM_LEN (1 << 20)
+
+// Pieces generated per `fsRandFill` call.
+#define CHUNK_LEN 4096
+
+// Number of drought histogram buckets. The last counts every longer drought.
+#define DROUGHT_LEN 64
+
 #include "framework.h"
-#include "faststack.h"
-#include <stdlib.h>
+#include <pthread.h>
 #include <stdio.h>
-
-static FSEngine engine;
+#include <time.h>
+#include <unistd.h>
 
 static const char *pieceTypeNames[] = {
     "I",
@@ -63,125 +83,328 @@ static const char *pieceTypeNames[] = {
     "None"
 };
 
-// Compute the distribution across a number of samples with the current
-// randomizer.
-static void test_distribution(int randomizerType, double targetVariance)
-{
-    engine.randomizer = randomizerType;
+static const struct {
+    const char *name;
+    int randomizer;
+    double variance;
+
+    /// Longest possible drought, or 0 if unbounded.
+    //
+    // A drought is the distance between two pieces of the same type, so two
+    // adjacent pieces have a drought of 1.
+    int maxDrought;
+} tests[] = {
+    { "Simple",          FST_RAND_SIMPLE,          VARIANCE_MEMORYLESS,       0 },
+    { "Bag7",            FST_RAND_BAG7,            VARIANCE_7_BAG,            13 },
+    { "Bag7 Seam Check", FST_RAND_BAG7_SEAM_CHECK, VARIANCE_7_BAG_SEAM_CHECK, 13 },
+    { "Bag6",            FST_RAND_BAG6,            VARIANCE_6_BAG,            0 },
+    { "Bag14",           FST_RAND_MULTI_BAG2,      VARIANCE_14_BAG,           0 },
+    { "Bag28",           FST_RAND_MULTI_BAG4,      VARIANCE_28_BAG,           0 },
+    { "Bag63",           FST_RAND_MULTI_BAG9,      VARIANCE_63_BAG,           0 },
+    { "TGM1",            FST_RAND_TGM1,            VARIANCE_TGM1,             0 },
+    { "TGM2",            FST_RAND_TGM2,            VARIANCE_TGM2,             0 },
+    { "TGM3",            FST_RAND_TGM3,            VARIANCE_TGM3,             0 },
+};
+
+///
+// Results of one or more piece streams.
+//
+// Everything is an integer count so merging results is exact and independent
+// of the order streams are merged in.
+///
+typedef struct {
+    /// How many times a specific piece has been seen.
+    uint64_t seen[FS_NPT];
+
+    // Variance Sum and Sum of Squares of the distance between two pieces of
+    // the same type.
+    //
+    // A distance is almost never more than a few hundred pieces, so the sum
+    // of squares stays far below 2^64 even for trillions of pieces.
+    uint64_t varSum;
+    uint64_t varSumSq;
+
+    /// Number of droughts of each length.
+    uint64_t drought[DROUGHT_LEN];
 
-    const uint64_t limit = 10000000;   // 10 Million
+    /// Longest drought seen.
+    uint64_t maxDrought;
+} Stats;
 
-    // How many times a specific piece has been seen
-    uint64_t seen[FS_NPT] = {0};
+typedef struct {
+    pthread_t thread;
+
+    /// Index of this worker and the number of workers.
+    int id;
+    int count;
+
+    int randomizer;
+    uint64_t pieceCount;
+    u32 seed;
+
+    Stats stats;
+
+    // Keep the stats of each worker on a separate cache line.
+    char pad[64];
+} Worker;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+///
+// Accumulate `length` pieces of the stream with the specified seed.
+///
+static void sampleStream(Stats *st, int randomizer, u32 seed, uint64_t length)
+{
+    FSBlock chunk[CHUNK_LEN];
+    FSRandCtx ctx;
+    FSRandState state;
 
     // The last index at which the specified piece was seen. For variance.
     uint64_t lastSeen[FS_NPT] = {0};
 
-    // Variance Sum and Sum of Squares.
-    //
-    // Will this overflow? The worst case would computing the square of the
-    // distance between 0 and the limit (100 million). This is < 2^64 so we
-    // are ok.
-    uint64_t varSum = 0;
-    uint64_t varSumSq = 0;
-
-    for (uint64_t i = 0; i < limit; ++i) {
-        const FSBlock ty = fsNextRandomPiece(&engine);
+    fsRandSeed(&ctx, seed);
+    fsRandStateInit(&ctx, &state, randomizer);
+
+    for (uint64_t i = 0; i < length; ++i) {
+        if (i % CHUNK_LEN == 0) {
+            fsRandFill(&ctx, &state, chunk, CHUNK_LEN);
+        }
+
+        const FSBlock ty = chunk[i % CHUNK_LEN];
         const uint64_t x = i - lastSeen[ty];
 
-        varSum += x;
-        varSumSq += x * x;
+        st->varSum += x;
+        st->varSumSq += x * x;
+        st->drought[x < DROUGHT_LEN ? x : DROUGHT_LEN - 1] += 1;
+        if (x > st->maxDrought) {
+            st->maxDrought = x;
+        }
 
-        seen[ty] += 1;
+        st->seen[ty] += 1;
         lastSeen[ty] = i;
     }
+}
+
+static void *runWorker(void *arg)
+{
+    Worker *w = arg;
+    const uint64_t streamCount = (w->pieceCount + STREAM_LEN - 1) / STREAM_LEN;
+
+    for (uint64_t s = w->id; s < streamCount; s += w->count) {
+        const uint64_t remaining = w->pieceCount - s * STREAM_LEN;
+        const uint64_t length = remaining < STREAM_LEN ? remaining : STREAM_LEN;
+        sampleStream(&w->stats, w->randomizer, w->seed + (u32) s, length);
+    }
+
+    return NULL;
+}
+
+static void mergeStats(Stats *dst, const Stats *src)
+{
+    for (int i = 0; i < FS_NPT; ++i) {
+        dst->seen[i] += src->seen[i];
+    }
+    for (int i = 0; i < DROUGHT_LEN; ++i) {
+        dst->drought[i] += src->drought[i];
+    }
+    dst->varSum += src->varSum;
+    dst->varSumSq += src->varSumSq;
+    if (src->maxDrought > dst->maxDrought) {
+        dst->maxDrought = src->maxDrought;
+    }
+}
+
+// Compute the distribution across a number of samples with the specified
+// randomizer.
+static double test_distribution(int index, Worker *workers, int threadCount,
+                                uint64_t limit, u32 seed)
+{
+    const double start = now();
+
+    for (int i = 0; i < threadCount; ++i) {
+        Worker *w = &workers[i];
+        memset(w, 0, sizeof(*w));
+        w->id = i;
+        w->count = threadCount;
+        w->randomizer = tests[index].randomizer;
+        w->pieceCount = limit;
+        w->seed = seed;
+
+        if (pthread_create(&w->thread, NULL, runWorker, w)) {
+            fprintf(stderr, "failed to create worker %d\n", i);
+            exit(1);
+        }
+    }
+
+    Stats st;
+    memset(&st, 0, sizeof(st));
+
+    for (int i = 0; i < threadCount; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        mergeStats(&st, &workers[i].stats);
+    }
+
+    const double elapsed = now() - start;
+
+    printf("\n%s Randomizer\n", tests[index].name);
 
     printf(" = Distribution\n");
     for (int i = 0; i < FS_NPT; ++i) {
-        const double weight = ((double) seen[i] * 100) / limit;
+        const double weight = ((double) st.seen[i] * 100) / limit;
         printf("    %s - %2.3f%%\n", pieceTypeNames[i], weight);
     }
 
+    // Each piece type is expected equally often.
+    const double expected = (double) limit / FS_NPT;
+    double chiSquared = 0;
+    for (int i = 0; i < FS_NPT; ++i) {
+        const double d = st.seen[i] - expected;
+        chiSquared += d * d / expected;
+    }
+
+    printf(" = Chi-Squared\n");
+    printf("    critical = %2.3f\n", CHI_SQUARED_CRITICAL);
+    printf("    actual = %2.3f\n", chiSquared);
+    CHECK(chiSquared < CHI_SQUARED_CRITICAL);
+
     printf(" = Variance\n");
-    const double variance = (double) (varSumSq - (varSum * varSum) / limit)
+    const double mean = (double) st.varSum / limit;
+    const double variance = ((double) st.varSumSq - mean * st.varSum)
                                         / (limit - 1);
-    printf("    target = %2.3f\n", targetVariance);
+    printf("    target = %2.3f\n", tests[index].variance);
     printf("    actual = %2.3f\n", variance);
-}
 
-static void test_simple(void)
-{
-    printf("\nSimple Randomizer\n");
-    test_distribution(FST_RAND_SIMPLE, VARIANCE_MEMORYLESS);
-}
+    printf(" = Drought\n");
+    int last = DROUGHT_LEN - 1;
+    while (last > 1 && !st.drought[last]) {
+        last -= 1;
+    }
+    for (int i = 1; i <= last; ++i) {
+        if (i % 8 == 1) {
+            printf("    %2d:", i);
+        }
+        printf(" %7.3f%%", ((double) st.drought[i] * 100) / limit);
+        if (i % 8 == 0 || i == last) {
+            printf("\n");
+        }
+    }
+    printf("    longest = %llu\n", (unsigned long long) st.maxDrought);
+    if (tests[index].maxDrought) {
+        CHECK(st.maxDrought <= (uint64_t) tests[index].maxDrought);
+    }
 
-static void test_bag7(void)
-{
-    printf("\nBag7 Randomizer\n");
-    test_distribution(FST_RAND_BAG7, VARIANCE_7_BAG);
-}
+    printf(" = Speed\n");
+    printf("    %.1f million pieces/s\n", limit / elapsed / 1e6);
 
-static void test_bag7_seam_check(void)
-{
-    printf("\nBag7 Seam Check Randomizer\n");
-    test_distribution(FST_RAND_BAG7_SEAM_CHECK, VARIANCE_7_BAG_SEAM_CHECK);
+    return elapsed;
 }
 
-static void test_bag6(void)
+// Every lane of a `FSRandLanes` must produce the same sequence as a scalar
+// context with the same seed.
+static void test_lanes(u32 seed)
 {
-    printf("\nBag6 Randomizer\n");
-    test_distribution(FST_RAND_BAG6, VARIANCE_6_BAG);
-}
+    printf("\nRandom Lanes\n");
 
-static void test_multi_bag2(void)
-{
-    printf("\nBag14 Randomizer\n");
-    test_distribution(FST_RAND_MULTI_BAG2, VARIANCE_14_BAG);
-}
+    FSRandLanes lanes;
+    FSRandCtx scalar[FS_RAND_LANES];
+    u32 seeds[FS_RAND_LANES];
+    u32 out[FS_RAND_LANES];
+    const int steps = 1000000;
 
-static void test_multi_bag4(void)
-{
-    printf("\nBag28 Randomizer\n");
-    test_distribution(FST_RAND_MULTI_BAG4, VARIANCE_28_BAG);
-}
+    for (int l = 0; l < FS_RAND_LANES; ++l) {
+        seeds[l] = seed * FS_RAND_LANES + l;
+        fsRandSeed(&scalar[l], seeds[l]);
+    }
+    fsRandLanesSeed(&lanes, seeds);
 
-static void test_multi_bag9(void)
-{
-    printf("\nBag63 Randomizer\n");
-    test_distribution(FST_RAND_MULTI_BAG9, VARIANCE_63_BAG);
-}
+    int mismatches = 0;
+    for (int i = 0; i < steps; ++i) {
+        fsRandLanesNext(&lanes, out);
+        for (int l = 0; l < FS_RAND_LANES; ++l) {
+            mismatches += out[l] != fsRandNext(&scalar[l]);
+        }
+    }
+    CHECK(mismatches == 0);
 
-static void test_tgm1(void)
-{
-    printf("\nTGM1 Randomizer\n");
-    test_distribution(FST_RAND_TGM1, VARIANCE_TGM1);
-}
+    // Time the lanes alone. The output is accumulated so it cannot be
+    // discarded.
+    u32 sum = 0;
+    const double start = now();
+    for (int i = 0; i < steps; ++i) {
+        fsRandLanesNext(&lanes, out);
+        sum += out[i % FS_RAND_LANES];
+    }
+    const double elapsed = now() - start;
 
-static void test_tgm2(void)
-{
-    printf("\nTGM2 Randomizer\n");
-    test_distribution(FST_RAND_TGM1, VARIANCE_TGM2);
+    printf("    %d lanes, %d mismatches (%08x)\n", FS_RAND_LANES, mismatches, sum);
+    printf("    %.1f million values/s\n",
+            (double) steps * FS_RAND_LANES / elapsed / 1e6);
 }
 
-static void test_tgm3(void)
+static void usage(const char *argv0)
 {
-    printf("\nTGM3 Randomizer\n");
-    test_distribution(FST_RAND_TGM3, VARIANCE_TGM3);
+    fprintf(stderr, "usage: %s [-t threads] [-n pieces] [-s seed]\n", argv0);
+    exit(1);
 }
 
-int main(void)
+int main(int argc, char **argv)
 {
-    engine.lastRandomizer = FST_RAND_UNDEFINED;
-    fsRandSeed(&engine.randomContext, fsGetRoughSeed());
-
-    test_simple();
-    test_bag7();
-    test_bag7_seam_check();
-    test_bag6();
-    test_multi_bag2();
-    test_multi_bag4();
-    test_multi_bag9();
-    test_tgm1();
-    test_tgm2();
-    test_tgm3();
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threadCount = cpus > 0 ? cpus : 1;
+    uint64_t limit = 10000000;   // 10 Million
+    u32 seed = 1;
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-' || argv[i][1] == 0 || argv[i][2] != 0 ||
+                i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+          case 't':
+            threadCount = atoi(value);
+            break;
+          case 'n':
+            limit = strtoull(value, NULL, 10);
+            break;
+          case 's':
+            seed = strtoul(value, NULL, 10);
+            break;
+          default:
+            usage(argv[0]);
+        }
+    }
+
+    if (threadCount < 1 || limit < 2) {
+        usage(argv[0]);
+    }
+
+    Worker *workers = calloc(threadCount, sizeof(Worker));
+    if (!workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    printf("threads %d, pieces %llu, seed %u\n", threadCount,
+            (unsigned long long) limit, seed);
+
+    test_lanes(seed);
+
+    const int testCount = sizeof(tests) / sizeof(tests[0]);
+    double elapsed = 0;
+    for (int i = 0; i < testCount; ++i) {
+        elapsed += test_distribution(i, workers, threadCount, limit, seed);
+    }
+
+    free(workers);
+
+    printf("\n%.1f million pieces/s overall\n", testCount * limit / elapsed / 1e6);
+    printf("\n%s\n", failures ? "FAILED" : "OK");
+    return failures != 0;
 }
@@ -0,0 +1,282 @@
+///
+// seedfind.c
+// ==========
+//
+// Recover the seed of a game from the pieces it dealt.
+//
+// Every seed in the requested range is tried in turn. A game seeds its PRNG
+// with `fsRandSeed` and deals pieces from it straight away, so each candidate
+// only generates pieces until the first one which differs from the observed
+// sequence. Most seeds are rejected on the first piece.
+//
+// Seeding costs more than rejecting, so seeds are expanded `FS_RAND_LANES` at
+// a time with `fsRandLanesSeed`. The seed range is split into blocks which are
+// handed to threads round-robin.
+//
+// Around 3 bags (21 pieces) of a 7-bag sequence identify a seed. Shorter
+// prefixes will usually match more than one seed.
+//
+// Usage: seedfind [-t threads] [-s start] [-n count] [-m max] randomizer pieces
+///
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <faststack.h>
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Seeds in a block of work given to a thread.
+#define BLOCK_LEN (1 << 20)
+
+// Longest piece sequence accepted.
+#define MAX_PIECES 256
+
+static const struct {
+    const char *name;
+    int randomizer;
+} randomizers[] = {
+    { "simple",    FST_RAND_SIMPLE },
+    { "bag7",      FST_RAND_BAG7 },
+    { "tgm1",      FST_RAND_TGM1 },
+    { "tgm2",      FST_RAND_TGM2 },
+    { "tgm3",      FST_RAND_TGM3 },
+    { "bag7-seam", FST_RAND_BAG7_SEAM_CHECK },
+    { "bag6",      FST_RAND_BAG6 },
+    { "bag14",     FST_RAND_MULTI_BAG2 },
+    { "bag28",     FST_RAND_MULTI_BAG4 },
+    { "bag63",     FST_RAND_MULTI_BAG9 },
+};
+
+typedef struct {
+    pthread_t thread;
+
+    /// Index of this worker and the number of workers.
+    int id;
+    int count;
+
+    /// Matching seeds found, of which the first `capacity` are stored.
+    u32 *matches;
+    int capacity;
+    long long matchCount;
+
+    // Keep the counts of each worker on a separate cache line.
+    char pad[64];
+} Worker;
+
+// Search parameters shared by every worker.
+static int randomizer;
+static FSBlock pieces[MAX_PIECES];
+static int pieceCount;
+static uint64_t start;
+static uint64_t seedCount;
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+///
+// Return if the seeded context deals the observed pieces.
+///
+static bool matches(FSRandCtx *ctx)
+{
+    FSRandState state;
+    FSBlock piece;
+
+    fsRandStateInit(ctx, &state, randomizer);
+    for (int i = 0; i < pieceCount; ++i) {
+        fsRandFill(ctx, &state, &piece, 1);
+        if (piece != pieces[i]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void *runWorker(void *arg)
+{
+    Worker *w = arg;
+    const uint64_t blockCount = (seedCount + BLOCK_LEN - 1) / BLOCK_LEN;
+
+    for (uint64_t block = w->id; block < blockCount; block += w->count) {
+        const uint64_t first = block * BLOCK_LEN;
+        const uint64_t last = first + BLOCK_LEN < seedCount ? first + BLOCK_LEN : seedCount;
+
+        for (uint64_t i = first; i < last; i += FS_RAND_LANES) {
+            FSRandLanes lanes;
+            u32 seeds[FS_RAND_LANES];
+            const u32 seed = (u32) (start + i);
+
+            for (int l = 0; l < FS_RAND_LANES; ++l) {
+                seeds[l] = seed + l;
+            }
+            fsRandLanesSeed(&lanes, seeds);
+
+            for (int l = 0; l < FS_RAND_LANES && i + l < last; ++l) {
+                FSRandCtx ctx;
+                fsRandLanesGet(&lanes, l, &ctx);
+                if (matches(&ctx)) {
+                    if (w->matchCount < w->capacity) {
+                        w->matches[w->matchCount] = seed + l;
+                    }
+                    w->matchCount += 1;
+                }
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static int compareSeeds(const void *a, const void *b)
+{
+    const u32 x = *(const u32 *) a;
+    const u32 y = *(const u32 *) b;
+    return (x > y) - (x < y);
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr,
+            "usage: %s [-t threads] [-s start] [-n count] [-m max] "
+            "randomizer pieces\n\n"
+            "pieces is the observed sequence, e.g. TJZSOIL\n"
+            "randomizer is one of:", argv0);
+    for (size_t i = 0; i < sizeof(randomizers) / sizeof(randomizers[0]); ++i) {
+        fprintf(stderr, " %s", randomizers[i].name);
+    }
+    fprintf(stderr, "\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threadCount = cpus > 0 ? cpus : 1;
+    int maxMatches = 16;
+    int i;
+
+    start = 0;
+    seedCount = (uint64_t) 1 << 32;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (argv[i][1] == 0 || argv[i][2] != 0 || i + 1 >= argc) {
+            usage(argv[0]);
+        }
+
+        const char *value = argv[++i];
+        switch (argv[i - 1][1]) {
+          case 't':
+            threadCount = atoi(value);
+            break;
+          case 's':
+            start = strtoull(value, NULL, 10);
+            break;
+          case 'n':
+            seedCount = strtoull(value, NULL, 10);
+            break;
+          case 'm':
+            maxMatches = atoi(value);
+            break;
+          default:
+            usage(argv[0]);
+        }
+    }
+
+    if (argc - i != 2 || threadCount < 1 || maxMatches < 0 ||
+            start > UINT32_MAX || seedCount > ((uint64_t) 1 << 32) - start) {
+        usage(argv[0]);
+    }
+
+    randomizer = FST_RAND_UNDEFINED;
+    for (size_t j = 0; j < sizeof(randomizers) / sizeof(randomizers[0]); ++j) {
+        if (!strcmp(argv[i], randomizers[j].name)) {
+            randomizer = randomizers[j].randomizer;
+        }
+    }
+    if (randomizer == FST_RAND_UNDEFINED) {
+        usage(argv[0]);
+    }
+
+    static const char pieceNames[] = "IJLOSTZ";
+    for (const char *p = argv[i + 1]; *p; ++p) {
+        const char *name = strchr(pieceNames, toupper((unsigned char) *p));
+        if (!name || pieceCount == MAX_PIECES) {
+            usage(argv[0]);
+        }
+        pieces[pieceCount++] = name - pieceNames;
+    }
+    if (pieceCount == 0) {
+        usage(argv[0]);
+    }
+
+    Worker *workers = calloc(threadCount, sizeof(Worker));
+    if (!workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    const double begin = now();
+
+    for (int t = 0; t < threadCount; ++t) {
+        Worker *w = &workers[t];
+        w->id = t;
+        w->count = threadCount;
+        w->capacity = maxMatches;
+        w->matches = malloc((maxMatches ? maxMatches : 1) * sizeof(u32));
+        if (!w->matches) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        if (pthread_create(&w->thread, NULL, runWorker, w)) {
+            fprintf(stderr, "failed to create worker %d\n", t);
+            return 1;
+        }
+    }
+
+    long long matchCount = 0;
+    int stored = 0;
+    u32 *found = malloc((size_t) threadCount * (maxMatches ? maxMatches : 1) * sizeof(u32));
+    if (!found) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    for (int t = 0; t < threadCount; ++t) {
+        Worker *w = &workers[t];
+        pthread_join(w->thread, NULL);
+
+        const int n = w->matchCount < w->capacity ? w->matchCount : w->capacity;
+        memcpy(&found[stored], w->matches, n * sizeof(u32));
+        stored += n;
+        matchCount += w->matchCount;
+        free(w->matches);
+    }
+
+    const double elapsed = now() - begin;
+
+    // Each worker keeps its first matches in its own blocks, so sort to
+    // report the lowest seeds found.
+    qsort(found, stored, sizeof(u32), compareSeeds);
+    for (int t = 0; t < stored && t < maxMatches; ++t) {
+        printf("%u\n", found[t]);
+    }
+
+    fprintf(stderr, "%lld matching seeds, %llu searched in %.1fs (%.1f million seeds/s)\n",
+            matchCount, (unsigned long long) seedCount, elapsed,
+            seedCount / elapsed / 1e6);
+
+    free(found);
+    free(workers);
+    return matchCount == 0;
+}
@@ -0,0 +1,456 @@
+///
+// verify.c
+// ========
+//
+// Verify every hiscore in the database against its replay.
+//
+// Each complete replay with a hiscore is read from the database in order and
+// queued for a pool of worker threads. A worker rebuilds the options of the
+// game exactly as playback does, simulates it headlessly tick by tick and
+// compares the time, TPS, KPT and goal it reaches with the stored hiscore.
+//
+// Replays older than `DAO_REPLAY_VERSION` were recorded with different game
+// rules, so they are counted as skipped instead of being verified.
+//
+// The database is opened read-only and only the main thread accesses it.
+//
+// Usage: faststack-verify [-t threads] [database]
+///
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <faststack.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Replays read ahead of the workers.
+#define QUEUE_LEN 256
+
+// Columns of the replay query. The replay_overview columns come last so any
+// added later do not move the others.
+enum {
+    COL_TIME,
+    COL_TPS,
+    COL_KPT,
+    COL_GOAL,
+    COL_DATA,
+    COL_VERSION,
+    COL_OVERVIEW
+};
+
+// Ticks simulated past the final key change before a game which has not
+// ended is reported, in milliseconds of game time.
+#define TAIL_MS 600000
+
+typedef struct {
+    u32 id;
+    u32 seed;
+    FSEngineConfig config;
+
+    /// Stored hiscore values. A NULL value is read as NaN.
+    double time;
+    double tps;
+    double kpt;
+    i32 goal;
+
+    /// Key changes in tick order.
+    FSReplayEvent *events;
+    i32 eventCount;
+} Job;
+
+typedef struct {
+    pthread_t thread;
+    int id;
+
+    long long verified;
+    long long mismatches;
+
+    // Keep the counts of each worker on a separate cache line.
+    char pad[64];
+} Worker;
+
+// Queue of jobs shared by the reader and the workers.
+static Job *queue[QUEUE_LEN];
+static int queueHead;
+static int queueCount;
+static bool queueDone;
+static pthread_mutex_t queueLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queueNotEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t queueNotFull = PTHREAD_COND_INITIALIZER;
+
+// option.c is linked through the DAO. This tool has no frontend, so there are
+// no frontend options or keys to set.
+const char *fsiFrontendName = "verify";
+
+void fsiUnpackFrontendOption(FSFrontend *v, const char *key, const char *value)
+{
+    (void) v;
+    (void) key;
+    (void) value;
+}
+
+void fsiAddToKeymap(FSFrontend *v, const int vkey, const char *key, bool isDefault)
+{
+    (void) v;
+    (void) vkey;
+    (void) key;
+    (void) isDefault;
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pushJob(Job *job)
+{
+    pthread_mutex_lock(&queueLock);
+    while (queueCount == QUEUE_LEN) {
+        pthread_cond_wait(&queueNotFull, &queueLock);
+    }
+    queue[(queueHead + queueCount++) % QUEUE_LEN] = job;
+    pthread_cond_signal(&queueNotEmpty);
+    pthread_mutex_unlock(&queueLock);
+}
+
+// Return the next job, or NULL once every replay has been read.
+static Job *popJob(void)
+{
+    Job *job = NULL;
+
+    pthread_mutex_lock(&queueLock);
+    while (queueCount == 0 && !queueDone) {
+        pthread_cond_wait(&queueNotEmpty, &queueLock);
+    }
+    if (queueCount) {
+        job = queue[queueHead];
+        queueHead = (queueHead + 1) % QUEUE_LEN;
+        queueCount -= 1;
+        pthread_cond_signal(&queueNotFull);
+    }
+    pthread_mutex_unlock(&queueLock);
+
+    return job;
+}
+
+static bool same(double a, double b)
+{
+    // NaN is stored as NULL, e.g. the KPT of a game with no blocks placed.
+    if (a != a || b != b) {
+        return a != a && b != b;
+    }
+
+    const double diff = a > b ? a - b : b - a;
+    const double scale = b > 1 ? b : (b < -1 ? -b : 1);
+    return diff <= 1e-9 * scale;
+}
+
+///
+// Simulate a replay as playback does and compare it with its hiscore.
+//
+// Returns true if the hiscore matches.
+///
+static bool verify(FSEngine *f, const Job *job)
+{
+    FSControl c;
+    FSKeyEvent events[FS_MAX_KEY_EVENTS];
+    i32 next = 0;
+    char report[512];
+    int n = 0;
+
+    fsGameInit(f, &job->config);
+    f->seed = job->seed;
+    fsGameReset(f);
+    f->replay = true;
+    memset(&c, 0, sizeof(c));
+
+    const i32 msPerTick = job->config.msPerTick > 0 ? job->config.msPerTick : 1;
+    const u32 lastTick = job->eventCount ? job->events[job->eventCount - 1].tick : 0;
+    const u32 limit = lastTick + TAIL_MS / msPerTick;
+
+    while (f->state != FSS_GAMEOVER && f->state != FSS_RESTART &&
+           f->state != FSS_QUIT && (u32) f->totalTicksRaw <= limit) {
+        const u32 tick = f->totalTicksRaw;
+        i32 count = 0;
+
+        for (; next < job->eventCount && job->events[next].tick <= tick; ++next) {
+            if (job->events[next].tick < tick) {
+                continue;
+            }
+
+            // Keep the final state if there are more changes than can be
+            // applied, as playback does.
+            if (count == FS_MAX_KEY_EVENTS) {
+                count -= 1;
+            }
+            events[count].time = job->events[next].time;
+            events[count].keys = job->events[next].keys;
+            count += 1;
+        }
+
+        fsGameTickEvents(f, &c, events, count, 0);
+    }
+
+    if (f->state != FSS_GAMEOVER) {
+        printf("replay %u: game did not end (%d ticks)\n", job->id, f->totalTicksRaw);
+        return false;
+    }
+
+    // Computed as daoSaveHiscore does.
+    const int msElapsed = f->config->msPerTick * f->totalTicks;
+    const double time = (double) msElapsed / 1000;
+    const double tps = (double) f->blocksPlaced / ((double) msElapsed / 1000);
+    const double kpt = (double) f->totalKeysPressed / f->blocksPlaced;
+
+    if (!same(time, job->time)) {
+        n += snprintf(report + n, sizeof(report) - n, " time %.3f != %.3f", time, job->time);
+    }
+    if (!same(tps, job->tps)) {
+        n += snprintf(report + n, sizeof(report) - n, " tps %.3f != %.3f", tps, job->tps);
+    }
+    if (!same(kpt, job->kpt)) {
+        n += snprintf(report + n, sizeof(report) - n, " kpt %.3f != %.3f", kpt, job->kpt);
+    }
+    if (f->config->goal != job->goal) {
+        n += snprintf(report + n, sizeof(report) - n, " goal %d != %d", f->config->goal, job->goal);
+    }
+
+    if (n) {
+        printf("replay %u:%s\n", job->id, report);
+        return false;
+    }
+
+    return true;
+}
+
+static void *runWorker(void *arg)
+{
+    Worker *w = arg;
+    FSEngine *f = malloc(sizeof(FSEngine));
+    Job *job;
+
+    if (!f) {
+        fprintf(stderr, "worker %d: out of memory\n", w->id);
+        exit(1);
+    }
+
+    while ((job = popJob())) {
+        w->verified += 1;
+        w->mismatches += !verify(f, job);
+
+        free(job->events);
+        free(job);
+    }
+
+    free(f);
+    return NULL;
+}
+
+static FSReplayEvent *appendEvent(Job *job, i32 *capacity)
+{
+    if (job->eventCount == *capacity) {
+        *capacity = *capacity ? 2 * *capacity : 1024;
+        job->events = realloc(job->events, *capacity * sizeof(FSReplayEvent));
+        if (!job->events) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+
+    return &job->events[job->eventCount++];
+}
+
+static double columnDouble(sqlite3_stmt *s, int column)
+{
+    if (sqlite3_column_type(s, column) == SQLITE_NULL) {
+        const double zero = 0;
+        return zero / zero;
+    }
+
+    return sqlite3_column_double(s, column);
+}
+
+///
+// Read the key changes of a replay, from its blob or the rows of replays
+// recorded before blobs.
+///
+static bool readEvents(sqlite3_stmt *s, sqlite3_stmt *legacy, Job *job)
+{
+    i32 capacity = 0;
+
+    if (sqlite3_column_type(s, COL_DATA) != SQLITE_NULL) {
+        const u8 *data = sqlite3_column_blob(s, COL_DATA);
+        const i32 length = sqlite3_column_bytes(s, COL_DATA);
+        FSReplayEvent last = { 0, 0, 0 };
+        FSEngineConfig header;
+        u32 seed;
+
+        i32 n = fsReplayDecodeHeader(data, length, &seed, &header);
+        if (n < 0) {
+            printf("replay %u: invalid header\n", job->id);
+            return false;
+        }
+
+        while (n < length) {
+            FSReplayEvent *e = appendEvent(job, &capacity);
+            const i32 r = fsReplayDecodeEvent(&data[n], length - n, &last, e);
+            if (r < 0) {
+                printf("replay %u: truncated\n", job->id);
+                return false;
+            }
+
+            last = *e;
+            n += r;
+        }
+
+        return true;
+    }
+
+    sqlite3_bind_int(legacy, 1, job->id);
+    while (sqlite3_step(legacy) == SQLITE_ROW) {
+        FSReplayEvent *e = appendEvent(job, &capacity);
+        e->tick = sqlite3_column_int(legacy, 0);
+        e->time = sqlite3_column_int(legacy, 1);
+        e->keys = sqlite3_column_int(legacy, 2);
+    }
+    sqlite3_reset(legacy);
+
+    return true;
+}
+
+static void usage(const char *argv0)
+{
+    fprintf(stderr, "usage: %s [-t threads] [database]\n", argv0);
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threadCount = cpus > 0 ? cpus : 1;
+    const char *path = NULL;
+    sqlite3 *db;
+    int i;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; ++i) {
+        if (strcmp(argv[i], "-t") || i + 1 >= argc) {
+            usage(argv[0]);
+        }
+        threadCount = atoi(argv[++i]);
+    }
+
+    if (argc - i > 1 || threadCount < 1) {
+        usage(argv[0]);
+    }
+    path = i < argc ? argv[i] : daoGetDatabasePath();
+
+    if (sqlite3_open_v2(path, &db, SQLITE_OPEN_READONLY, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", path, sqlite3_errmsg(db));
+        return 1;
+    }
+
+    const char select_stmt[] =
+        "select h.time, h.tps, h.kpt, h.goal, d.data, o.version, o.* "
+        "from replay_overview o "
+        "join hiscore h on h.replay_id = o.id "
+        "left join replay_data d on d.replay_id = o.id "
+        "where o.complete = 1 order by o.id;";
+    const char legacy_stmt[] =
+        "select tick, tick_time, keystate from replay_input "
+        "where replay_id = ? order by id;";
+
+    sqlite3_stmt *s, *legacy;
+    if (sqlite3_prepare_v2(db, select_stmt, sizeof(select_stmt), &s, NULL) != SQLITE_OK ||
+            sqlite3_prepare_v2(db, legacy_stmt, sizeof(legacy_stmt), &legacy, NULL) != SQLITE_OK) {
+        fprintf(stderr, "%s: %s\n", path, sqlite3_errmsg(db));
+        return 1;
+    }
+
+    Worker *workers = calloc(threadCount, sizeof(Worker));
+    if (!workers) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    const double begin = now();
+
+    // The piece masks are initialized on first use, which must complete
+    // before any worker starts.
+    fsInitPieceMasks();
+
+    for (int t = 0; t < threadCount; ++t) {
+        workers[t].id = t;
+        if (pthread_create(&workers[t].thread, NULL, runWorker, &workers[t])) {
+            fprintf(stderr, "failed to create worker %d\n", t);
+            return 1;
+        }
+    }
+
+    long long unreadable = 0;
+    long long skipped = 0;
+    while (sqlite3_step(s) == SQLITE_ROW) {
+        if (sqlite3_column_int(s, COL_VERSION) < DAO_REPLAY_VERSION) {
+            skipped += 1;
+            continue;
+        }
+
+        Job *job = calloc(1, sizeof(Job));
+        if (!job) {
+            fprintf(stderr, "out of memory\n");
+            return 1;
+        }
+
+        // Options not stored in a replay take their defaults, as in playback.
+        job->id = sqlite3_column_int(s, COL_OVERVIEW);
+        fsConfigInit(&job->config);
+        daoReadReplayOverview(s, COL_OVERVIEW, &job->seed, &job->config);
+        job->time = columnDouble(s, COL_TIME);
+        job->tps = columnDouble(s, COL_TPS);
+        job->kpt = columnDouble(s, COL_KPT);
+        job->goal = sqlite3_column_int(s, COL_GOAL);
+
+        if (!readEvents(s, legacy, job)) {
+            unreadable += 1;
+            free(job->events);
+            free(job);
+            continue;
+        }
+
+        pushJob(job);
+    }
+
+    pthread_mutex_lock(&queueLock);
+    queueDone = true;
+    pthread_cond_broadcast(&queueNotEmpty);
+    pthread_mutex_unlock(&queueLock);
+
+    long long verified = 0;
+    long long mismatches = unreadable;
+    for (int t = 0; t < threadCount; ++t) {
+        pthread_join(workers[t].thread, NULL);
+        verified += workers[t].verified;
+        mismatches += workers[t].mismatches;
+    }
+
+    const double elapsed = now() - begin;
+
+    fprintf(stderr, "%lld replays verified, %lld mismatches in %.1fs (%.1f replays/s)\n",
+            verified + unreadable, mismatches, elapsed,
+            elapsed > 0 ? (verified + unreadable) / elapsed : 0);
+    if (skipped) {
+        fprintf(stderr, "%lld replays older than version %d skipped\n",
+                skipped, DAO_REPLAY_VERSION);
+    }
+
+    sqlite3_finalize(s);
+    sqlite3_finalize(legacy);
+    sqlite3_close(db);
+    free(workers);
+    return mismatches != 0;
+}